@@ -0,0 +1,66 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "rtweekend.h"
+
+#include <utility>
+
+/*Axis-aligned bounding box. The box is the intersection of three "slabs", i.e. the regions between two parallel planes.
+A ray hits the box when the t intervals in which it crosses each slab overlap. See:
+https://raytracing.github.io/books/RayTracingTheNextWeek.html#boundingvolumehierarchies/axis-alignedboundingboxes(aabbs)*/
+
+class aabb {
+    public:
+        aabb() {}
+        aabb(const point3& a, const point3& b) : minimum(a), maximum(b) {}
+
+        point3 min() const { return minimum; }
+        point3 max() const { return maximum; }
+
+        // Andrew Kensler's version of the slab test
+        bool hit(const ray& r, real t_min, real t_max) const {
+            for (int a = 0; a < 3; a++) {
+                auto invD = 1.0 / r.direction()[a];
+                auto t0 = (minimum[a] - r.origin()[a]) * invD;
+                auto t1 = (maximum[a] - r.origin()[a]) * invD;
+
+                if (invD < 0.0)
+                    std::swap(t0, t1);
+
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+
+                if (t_max <= t_min)
+                    return false;
+            }
+
+            return true;
+        }
+
+        point3 centroid() const { return 0.5 * (minimum + maximum); }
+
+        // Used by the surface area heuristic: the chance that a random ray hits the box is proportional to its area
+        double surface_area() const {
+            auto d = maximum - minimum;
+            return 2.0 * (d.x()*d.y() + d.y()*d.z() + d.z()*d.x());
+        }
+
+    public:
+        point3 minimum;
+        point3 maximum;
+};
+
+// Smallest box that contains both boxes
+inline aabb surrounding_box(const aabb& box0, const aabb& box1) {
+    point3 small(fmin(box0.min().x(), box1.min().x()),
+                 fmin(box0.min().y(), box1.min().y()),
+                 fmin(box0.min().z(), box1.min().z()));
+
+    point3 big(fmax(box0.max().x(), box1.max().x()),
+               fmax(box0.max().y(), box1.max().y()),
+               fmax(box0.max().z(), box1.max().z()));
+
+    return aabb(small, big);
+}
+
+#endif
\ No newline at end of file
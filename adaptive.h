@@ -0,0 +1,138 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include "rtweekend.h"
+
+#include "framebuffer.h"
+#include "render.h"
+
+#include <algorithm>
+#include <vector>
+
+/*Adaptive sampling.
+
+With a fixed number of samples per pixel, a flat patch of sky gets as many samples as the blurred edge of a glass
+sphere, although it converged after a handful. Here each pixel keeps the running mean and variance of the brightness
+of its samples (Welford's algorithm, see https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance). The
+standard error of the mean, sqrt(variance/n), tells how far the pixel probably is from its converged value.
+
+The budget is the same as with fixed sampling, samples_per_pixel for every pixel, but it is spent in two passes:
+
+    1. Every pixel takes min_samples samples, then batches of batch more until its error is below the threshold or it
+       used its samples_per_pixel. Flat regions stop early and leave part of the budget unused.
+    2. The leftover goes to the pixels that are still noisy. Since the error falls as 1/sqrt(n), a pixel with error e
+       after n samples needs about n (e/threshold)^2 in total. Each one gets that many (up to max_samples), scaled
+       down evenly if the leftover is not enough for all.
+
+The error is measured after the gamma correction of write_color (a square root), i.e. in the units of the image:
+sqrt(mean + error) - sqrt(mean) ~ error / (2 sqrt(mean)). A threshold of 0.5/255 stops at half a gray level.*/
+
+struct adaptive_settings {
+    double threshold = 0.5/255;     // Target standard error of a pixel, in [0,1] display units
+    int min_samples = 16;           // Samples every pixel takes before its error is trusted
+    int batch = 8;                  // Samples between two checks of the error
+    int max_samples = 0;            // Cap per pixel. 0 uses 4 * samples_per_pixel
+};
+
+// Running statistics of one pixel
+struct pixel_estimate {
+    color sum;
+    int n = 0;
+    double mean = 0;    // Mean brightness
+    double m2 = 0;      // Sum of squared deviations from the mean
+
+    void add(const color& c) {
+        sum += c;
+        n++;
+
+        auto y = (c.x() + c.y() + c.z()) / 3;
+        auto delta = y - mean;
+        mean += delta / n;
+        m2 += delta * (y - mean);
+    }
+
+    // Standard error of the mean brightness, after gamma correction
+    double error() const {
+        if (n < 2) return infinity;
+
+        auto variance = m2 / (n - 1);
+        return sqrt(variance / n) / (2 * sqrt(fmax(mean, 1e-4)));
+    }
+};
+
+// Renders with sample(i, j), the color of one sample of pixel (i, j). Every pixel keeps its own random stream
+// through both passes, and the leftover is shared out on a single thread, so the result does not depend on the threads.
+// Returns false if the render was cancelled (see render_control), leaving the pixels not sampled at 0 samples.
+template <typename Sample>
+bool render_adaptive(const render_settings& settings, const adaptive_settings& adaptive, framebuffer& image,
+                     Sample sample) {
+
+    int max_samples = adaptive.max_samples > 0 ? adaptive.max_samples : 4 * settings.samples_per_pixel;
+    int min_samples = std::min(adaptive.min_samples, settings.samples_per_pixel);
+    int width = settings.image_width;
+    size_t pixels = static_cast<size_t>(width) * settings.image_height;
+
+    std::vector<pixel_estimate> estimates(pixels);
+    std::vector<rng> streams(pixels);
+    std::vector<int> extra(pixels, 0);
+
+    auto take_samples = [&](int i, int j, int count) {
+        auto p = static_cast<size_t>(j) * width + i;
+
+        thread_rng() = streams[p];
+        for (int s = 0; s < count; ++s)
+            estimates[p].add(sample(i, j));
+        streams[p] = thread_rng();
+    };
+
+    // 1. Up to samples_per_pixel, stopping once converged
+    bool completed = render_tiles(settings, [&](const tile& t) {
+        for (int j = t.y1-1; j >= t.y0; --j) {
+            for (int i = t.x0; i < t.x1; ++i) {
+                auto& e = estimates[static_cast<size_t>(j) * width + i];
+                streams[static_cast<size_t>(j) * width + i] = rng(settings.seed, pixel_stream(settings, i, j));
+
+                take_samples(i, j, min_samples);
+                while (e.n < settings.samples_per_pixel && e.error() > adaptive.threshold)
+                    take_samples(i, j, std::min(adaptive.batch, settings.samples_per_pixel - e.n));
+            }
+        }
+    });
+
+    // Share out the leftover
+    double leftover = static_cast<double>(settings.samples_per_pixel) * pixels;
+    double wanted = 0;
+    for (size_t p = 0; p < pixels; ++p) {
+        const auto& e = estimates[p];
+        leftover -= e.n;
+
+        auto ratio = e.error() / adaptive.threshold;
+        if (ratio > 1)
+            extra[p] = static_cast<int>(fmin(max_samples - e.n, ceil(e.n * ratio * ratio) - e.n));
+        wanted += extra[p];
+    }
+
+    if (wanted > leftover)
+        for (auto& n : extra)
+            n = static_cast<int>(n * (leftover / wanted));
+
+    // 2. The extra samples of the noisy pixels
+    if (completed) {
+        completed = render_tiles(settings, [&](const tile& t) {
+            for (int j = t.y1-1; j >= t.y0; --j)
+                for (int i = t.x0; i < t.x1; ++i)
+                    take_samples(i, j, extra[static_cast<size_t>(j) * width + i]);
+        });
+    }
+
+    for (int j = 0; j < settings.image_height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            const auto& e = estimates[static_cast<size_t>(j) * width + i];
+            image.store(i, j, e.sum, e.n);
+        }
+    }
+
+    return completed;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#ifndef AOV_H
+#define AOV_H
+
+#include "rtweekend.h"
+
+#include "framebuffer.h"
+#include "hittable.h"
+#include "material.h"
+#include "render.h"
+
+/*Auxiliary buffers (AOVs, arbitrary output variables) for the denoiser of denoise.h.
+
+For each pixel: the albedo, the normal and the distance of the first surface the camera sees. They only need the
+first hit, so they cost a fraction of a path per sample, and they tell the denoiser where the edges of the image
+are. With depth of field, the blurred edges take more samples (16 or so) than the sharp ones. Each is a framebuffer, with the sums of the samples and their counts like the image, so they are
+antialiased the same way and can be written with image_io.h (pfm keeps the negative normals and the depths).
+
+Glass and mirrors have no albedo of their own and show what is behind or in front of them, so they are followed (up
+to aov_max_specular of them) to the surface they show, whose edges the denoiser should keep. A mirror tints it with
+its albedo. The sky's albedo is its color, so the image divided by the albedo (see denoise.h) is a flat 1 there; its
+normal and depth are 0.*/
+
+const int aov_max_specular = 8;         // Glass and mirror surfaces followed
+const real aov_max_fuzz = 0.1;          // Metals up to this fuzz are mirrors
+
+// Added to the seed of the render, so the AOVs draw other random numbers than the image
+const uint64_t aov_seed = 0x9e3779b97f4a7c15;
+
+class aov_buffers {
+    public:
+        aov_buffers(int w, int h, int origin_x = 0, int origin_y = 0)
+            : albedo(w, h, origin_x, origin_y), normal(w, h, origin_x, origin_y), depth(w, h, origin_x, origin_y) {}
+
+    public:
+        framebuffer albedo;
+        framebuffer normal;             // World space, facing the camera
+        framebuffer depth;              // Length of the path to the surface, in the three channels
+};
+
+struct aov_sample {
+    color albedo;
+    vec3 normal;
+    real depth;
+};
+
+// The surface seen along r and its albedo. sky(r) is the color of the rays that hit nothing
+template <typename Sky>
+aov_sample trace_aov(ray r, const hittable& world, real t_min, Sky sky) {
+
+    real distance = 0;
+    color tint(1, 1, 1);
+    hit_record rec;
+
+    for (int k = 0; k <= aov_max_specular; ++k) {
+        if (!world.hit(r, t_min, infinity, rec))
+            break;
+
+        distance += rec.t * r.direction().length();
+
+        switch (rec.mat_ptr->kind) {
+            case material_kind::lambertian:
+                return {tint * static_cast<const lambertian*>(rec.mat_ptr)->albedo, rec.normal, distance};
+            case material_kind::metal: {
+                auto m = static_cast<const metal*>(rec.mat_ptr);
+                if (m->fuzz > aov_max_fuzz)
+                    return {tint * m->albedo, rec.normal, distance};
+
+                // A mirror shows what it reflects, tinted by its albedo
+                tint = tint * m->albedo;
+                r = ray(rec.p, reflect(r.direction(), rec.normal));
+                continue;
+            }
+            case material_kind::dielectric: {
+                // Through the glass, or off it, as a path would go
+                color attenuation;
+                ray scattered;
+                scatter_material(*rec.mat_ptr, r, rec, attenuation, scattered);
+                r = scattered;
+                continue;
+            }
+            default:
+                return {tint, rec.normal, distance};
+        }
+    }
+
+    return {tint * sky(r), vec3(0, 0, 0), 0};
+}
+
+// Fills aovs with samples samples per pixel of camera_ray(i, j), a random ray through pixel (i, j)
+template <typename CameraRay, typename Sky>
+bool render_aovs(const render_settings& settings, aov_buffers& aovs, int samples, const hittable& world, real t_min,
+                 CameraRay camera_ray, Sky sky) {
+
+    return render_tiles(settings, [&](const tile& t) {
+        for (int j = t.y1-1; j >= t.y0; --j) {
+            for (int i = t.x0; i < t.x1; ++i) {
+                seed_random(settings.seed + aov_seed, pixel_stream(settings, i, j));
+
+                color albedo, normal, depth;
+                for (int s = 0; s < samples; ++s) {
+                    auto a = trace_aov(camera_ray(i, j), world, t_min, sky);
+                    albedo += a.albedo;
+                    normal += a.normal;
+                    depth += color(a.depth, a.depth, a.depth);
+                }
+
+                aovs.albedo.store(i, j, albedo, samples);
+                aovs.normal.store(i, j, normal, samples);
+                aovs.depth.store(i, j, depth, samples);
+            }
+        }
+    });
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*Bump (arena) allocator.
+
+Memory is taken from a few large blocks: an allocation just moves a pointer forward, and objects allocated one after
+the other end up next to each other in memory. Nothing is freed on its own, the blocks are released all at once when
+the arena is destroyed, so it only holds objects that need no destructor. See
+https://en.wikipedia.org/wiki/Region-based_memory_management*/
+
+class arena {
+    public:
+        static const size_t block_alignment = 64;      // A cache line
+
+        explicit arena(size_t block_size = 64 * 1024) : block_size(block_size) {}
+
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        arena(arena&& other) noexcept { swap(other); }
+        arena& operator=(arena&& other) noexcept { swap(other); return *this; }
+
+        ~arena() {
+            for (auto& b : blocks)
+                ::operator delete(b.data, std::align_val_t(block_alignment));
+        }
+
+        // size bytes aligned to align (at most block_alignment)
+        void* allocate(size_t size, size_t align) {
+            size_t start = (used + align - 1) & ~(align - 1);
+
+            if (blocks.empty() || start + size > blocks.back().size) {
+                // Requests larger than a block get a block of their own
+                add_block(std::max(size, block_size));
+                start = 0;
+            }
+
+            used = start + size;
+            bytes_allocated += size;
+            return blocks.back().data + start;
+        }
+
+        // New T in the arena. T must not need its destructor, since it is never called
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+            static_assert(alignof(T) <= block_alignment, "over-aligned type in arena");
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        // Array of n default-constructed T
+        template <typename T>
+        T* make_array(size_t n) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+            static_assert(alignof(T) <= block_alignment, "over-aligned type in arena");
+            return new (allocate(n * sizeof(T), alignof(T))) T[n];
+        }
+
+        size_t bytes_used() const { return bytes_allocated; }          // Sum of the allocations
+        size_t bytes_reserved() const {                                 // Size of the blocks
+            size_t total = 0;
+            for (const auto& b : blocks) total += b.size;
+            return total;
+        }
+        size_t block_count() const { return blocks.size(); }
+
+    private:
+        struct block {
+            char* data;
+            size_t size;
+        };
+
+        void add_block(size_t size) {
+            size = (size + block_alignment - 1) & ~(block_alignment - 1);
+            blocks.push_back({static_cast<char*>(::operator new(size, std::align_val_t(block_alignment))), size});
+        }
+
+        void swap(arena& other) noexcept {
+            std::swap(block_size, other.block_size);
+            std::swap(blocks, other.blocks);
+            std::swap(used, other.used);
+            std::swap(bytes_allocated, other.bytes_allocated);
+        }
+
+        size_t block_size = 64 * 1024;
+        std::vector<block> blocks;
+        size_t used = 0;                // Bytes used in the last block
+        size_t bytes_allocated = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,435 @@
+#include "rtweekend.h"
+
+#include "hittable_list.h"
+#include "sphere.h"
+#include "camera.h"
+#include "material.h"
+#include "scenes.h"
+#include "compiled_scene.h"
+#include "sphere_set.h"
+#include "framebuffer.h"
+#include "render.h"
+#include "integrator.h"
+#include "renderer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+Benchmarks, written to the standard output as JSON so runs can be compared over time.
+
+cmake --build build --target benchmark && ./build/benchmark > bench.json
+
+Microbenchmarks report the time of one call (ns_per_op): sphere::hit on rays that hit and rays that miss,
+hittable_list::hit and the compiled BVH at 10 to 100k spheres, the scatter of each material, camera::get_ray, the
+random number generator and the sampling kernels of sampling.h. The end-to-end runs render the scenes of final.cpp and
+metal.cpp with a fixed seed and report the rays traced per second (mrays_per_s), counting every call to world.hit,
+i.e. camera rays and bounces.
+
+The convergence runs render the scene of final.cpp with each sampler of sampler.h at 1 to 64 samples per pixel and
+report the RMSE (in 8-bit levels, after gamma) against a render with many more samples. They take a while, so they
+only run with --convergence.
+
+Each run is an entry convergence/SAMPLER/SPP of the output, so the samplers compare at the same sample count, or by
+the sample count each needs for the same error.
+
+--quick         shorter runs, for a smoke test
+--threads N     threads of the end-to-end and convergence runs (all the cores by default)
+--convergence   adds the convergence runs
+*/
+
+double min_seconds = 0.25;      // Each microbenchmark repeats its batch for at least this long
+
+// Stops the compiler from optimizing away a value that is never used
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct result {
+    std::string name;
+    double ns_per_op;       // Microbenchmarks
+    double mrays_per_s;     // End-to-end runs
+    double rmse;            // Convergence runs
+    long ops;
+    double seconds;
+};
+
+std::vector<result> results;
+
+// Runs batch() (which does ops_per_batch operations) until min_seconds have passed
+template <typename Batch>
+void measure(const std::string& name, long ops_per_batch, Batch batch) {
+    using clock = std::chrono::steady_clock;
+
+    batch();    // Warm up
+    long ops = 0;
+    auto start = clock::now();
+    std::chrono::duration<double> elapsed(0);
+    do {
+        batch();
+        ops += ops_per_batch;
+        elapsed = clock::now() - start;
+    } while (elapsed.count() < min_seconds);
+
+    results.push_back({name, 1e9 * elapsed.count() / ops, 0, 0, ops, elapsed.count()});
+    std::fprintf(stderr, "%-28s %10.2f ns\n", name.c_str(), results.back().ns_per_op);
+}
+
+// Rays from random points on a sphere of radius 3 around the origin, aimed at a random point of the unit ball (so
+// they go towards the middle of the scene) or away from it
+std::vector<ray> random_rays(int count, bool inward) {
+    std::vector<ray> rays;
+    for (int k = 0; k < count; ++k) {
+        auto origin = 3 * random_unit_vector();
+        auto target = 0.9 * random_in_unit_sphere();
+        rays.emplace_back(origin, inward ? target - origin : origin - target);
+    }
+    return rays;
+}
+
+void bench_sphere() {
+    sphere s(point3(0, 0, 0), 1, make_shared<lambertian>(color(0.5, 0.5, 0.5)));
+
+    for (bool inward : {true, false}) {
+        auto rays = random_rays(1024, inward);
+        measure(inward ? "sphere_hit/hit" : "sphere_hit/miss", rays.size(), [&] {
+            hit_record rec;
+            for (const auto& r : rays) {
+                bool hit = s.hit(r, ray_t_min, infinity, rec);
+                keep(hit);
+            }
+        });
+    }
+}
+
+// Spheres of radius 0.2 spread uniformly over a box whose volume grows with their number, so the density is the same
+hittable_list random_spheres(int count) {
+    hittable_list list;
+    auto material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    auto side = cbrt(static_cast<double>(count));
+
+    for (int k = 0; k < count; ++k)
+        list.add(make_shared<sphere>(side * vec3::random(-1, 1), 0.2, material));
+
+    return list;
+}
+
+void bench_scene_sizes() {
+    for (int count : {10, 100, 1000, 10000, 100000}) {
+        auto list = random_spheres(count);
+        auto side = cbrt(static_cast<double>(count));
+
+        // Rays from outside the box towards its middle
+        std::vector<ray> rays;
+        for (int k = 0; k < 256; ++k) {
+            auto origin = 2 * side * random_unit_vector();
+            rays.emplace_back(origin, side * random_in_unit_sphere() - origin);
+        }
+
+        // The list tests every sphere, so it only gets a few rays at the larger sizes
+        size_t list_rays = count <= 1000 ? rays.size() : 16;
+        measure("hittable_list_hit/" + std::to_string(count), list_rays, [&] {
+            hit_record rec;
+            for (size_t k = 0; k < list_rays; ++k) {
+                bool hit = list.hit(rays[k], ray_t_min, infinity, rec);
+                keep(hit);
+            }
+        });
+
+        compiled_scene scene(list);
+        measure("compiled_scene_hit/" + std::to_string(count), rays.size(), [&] {
+            hit_record rec;
+            for (const auto& r : rays) {
+                bool hit = scene.hit(r, ray_t_min, infinity, rec);
+                keep(hit);
+            }
+        });
+    }
+}
+
+void bench_scatter() {
+    lambertian diffuse(color(0.5, 0.5, 0.5));
+    metal shiny(color(0.7, 0.6, 0.5), 0.2);
+    dielectric glass(1.5);
+
+    struct { const char* name; const material* m; } materials[] = {
+        {"scatter/lambertian", &diffuse}, {"scatter/metal", &shiny}, {"scatter/dielectric", &glass}
+    };
+
+    // Hits on the unit sphere
+    sphere s(point3(0, 0, 0), 1, nullptr);
+    std::vector<ray> rays;
+    std::vector<hit_record> hits;
+    for (const auto& r : random_rays(1024, true)) {
+        hit_record rec;
+        if (s.hit(r, ray_t_min, infinity, rec)) {
+            rays.push_back(r);
+            hits.push_back(rec);
+        }
+    }
+
+    for (const auto& entry : materials) {
+        measure(entry.name, rays.size(), [&] {
+            for (size_t k = 0; k < rays.size(); ++k) {
+                color attenuation;
+                ray scattered;
+                bool alive = entry.m->scatter(rays[k], hits[k], attenuation, scattered);
+                keep(alive);
+                keep(scattered);
+            }
+        });
+    }
+}
+
+void bench_camera_and_rng() {
+    auto cam = random_scene_camera(3.0 / 2.0);
+
+    measure("camera_get_ray", 1024, [&] {
+        for (int k = 0; k < 1024; ++k) {
+            ray r = cam.get_ray(random_double(), random_double());
+            keep(r);
+        }
+    });
+
+    measure("rng/next_double", 4096, [&] {
+        for (int k = 0; k < 4096; ++k) {
+            double x = random_double();
+            keep(x);
+        }
+    });
+
+    measure("rng/random_unit_vector", 1024, [&] {
+        for (int k = 0; k < 1024; ++k) {
+            vec3 v = random_unit_vector();
+            keep(v);
+        }
+    });
+
+    measure("rng/random_in_unit_sphere", 1024, [&] {
+        for (int k = 0; k < 1024; ++k) {
+            vec3 v = random_in_unit_sphere();
+            keep(v);
+        }
+    });
+
+    measure("rng/random_in_unit_disk", 1024, [&] {
+        for (int k = 0; k < 1024; ++k) {
+            vec3 v = random_in_unit_disk();
+            keep(v);
+        }
+    });
+
+    auto normal = unit_vector(vec3(0.3, 0.8, -0.2));
+    measure("rng/random_cosine_direction", 1024, [&] {
+        for (int k = 0; k < 1024; ++k) {
+            vec3 v = random_cosine_direction(normal);
+            keep(v);
+        }
+    });
+
+    // The kernel alone, on uniforms drawn beforehand: one op is one point
+    std::vector<real> u1(1024), u2(1024), x(1024), y(1024), z(1024);
+    for (int k = 0; k < 1024; ++k) {
+        u1[k] = random_double();
+        u2[k] = random_double();
+    }
+    measure("sampling/cosine_hemisphere_batch", 1024, [&] {
+        cosine_hemisphere_batch(u1.data(), u2.data(), x.data(), y.data(), z.data(), u1.size());
+        keep(z[0]);
+    });
+}
+
+// Rays traced by this thread, see counting_world
+inline long& thread_rays() {
+    thread_local long count = 0;
+    return count;
+}
+
+// Counts the calls to hit of the world it wraps
+class counting_world : public hittable {
+    public:
+        counting_world(const hittable& w) : world(w) {}
+
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override {
+            thread_rays()++;
+            return world.hit(r, t_min, t_max, rec);
+        }
+
+        virtual bool bounding_box(aabb& output_box) const override { return world.bounding_box(output_box); }
+
+    private:
+        const hittable& world;
+};
+
+// Renders world with ray_color and records the rays per second
+void bench_render(const std::string& name, const hittable& world, const camera& cam, render_settings settings) {
+    counting_world counted(world);
+    framebuffer image(settings.image_width, settings.image_height);
+    std::atomic<long> rays(0);
+
+    auto start = std::chrono::steady_clock::now();
+    render(settings, image, [&](int i, int j) {
+        long before = thread_rays();
+        color pixel_color(0, 0, 0);
+        for (int s = 0; s < settings.samples_per_pixel; ++s) {
+            auto u = (i + random_double()) / (settings.image_width-1);
+            auto v = (j + random_double()) / (settings.image_height-1);
+            pixel_color += ray_color(cam.get_ray(u, v), counted, settings.max_depth);
+        }
+        rays += thread_rays() - before;
+        return pixel_color;
+    });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    results.push_back({name, 0, rays / elapsed.count() / 1e6, 0, rays.load(), elapsed.count()});
+    std::fprintf(stderr, "\n%-28s %10.2f Mrays/s\n", name.c_str(), results.back().mrays_per_s);
+}
+
+void bench_end_to_end(int threads, bool quick) {
+    render_settings settings;
+    settings.threads = threads;
+    settings.seed = 0;
+    settings.max_depth = 50;
+    settings.samples_per_pixel = quick ? 4 : 32;
+
+    // final.cpp, at a sixth of its size
+    seed_random(settings.seed);
+    compiled_scene final_world(random_scene());
+    settings.image_width = 200;
+    settings.image_height = 133;
+    bench_render("render/final", final_world, random_scene_camera(3.0 / 2.0), settings);
+
+    // metal.cpp, at a quarter of its size
+    sphere_set metal_world(metal_scene());
+    settings.image_width = 200;
+    settings.image_height = 112;
+    bench_render("render/metal", metal_world, metal_scene_camera(16.0 / 9.0), settings);
+}
+
+// Difference of two images in 8-bit levels, after the gamma of image_io.h but without its rounding
+double image_rmse(const framebuffer& a, const framebuffer& b) {
+    double sum = 0;
+    for (size_t p = 0; p < a.pixels.size(); ++p) {
+        for (int k = 0; k < 3; ++k) {
+            auto x = sqrt(clamp(a.pixels[p][k] / a.samples[p], 0, 1));
+            auto y = sqrt(clamp(b.pixels[p][k] / b.samples[p], 0, 1));
+            sum += (x - y) * (x - y);
+        }
+    }
+    return 255 * sqrt(sum / (3 * a.pixels.size()));
+}
+
+void bench_convergence(int threads, bool quick) {
+    render_settings settings;
+    render_control quiet;
+    settings.threads = threads;
+    settings.control = &quiet;
+    settings.image_width = 120;
+    settings.image_height = 80;
+    settings.max_depth = 50;
+
+    seed_random(0);
+    compiled_scene world(random_scene());
+    camera cam = random_scene_view(3.0 / 2.0).make_camera();
+
+    render_options options;
+    options.integrator = integrator_kind::path;
+
+    // The reference takes another seed, so its own noise is independent of the runs
+    framebuffer reference(settings.image_width, settings.image_height);
+    settings.samples_per_pixel = quick ? 256 : 2048;
+    settings.seed = 1;
+    render(world, cam, settings, reference, options);
+    std::fprintf(stderr, "convergence reference        %d spp\n", settings.samples_per_pixel);
+
+    struct { const char* name; sampler_kind kind; } samplers[] = {
+        {"random", sampler_kind::random}, {"sobol", sampler_kind::sobol}, {"halton", sampler_kind::halton},
+        {"blue-noise", sampler_kind::blue_noise}
+    };
+
+    settings.seed = 0;
+    for (const auto& entry : samplers) {
+        options.sampler = entry.kind;
+        for (int spp : {1, 4, 16, 64}) {
+            if (quick && spp > 4)
+                break;
+
+            framebuffer image(settings.image_width, settings.image_height);
+            settings.samples_per_pixel = spp;
+            auto start = std::chrono::steady_clock::now();
+            render(world, cam, settings, image, options);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            auto name = std::string("convergence/") + entry.name + "/" + std::to_string(spp);
+            results.push_back({name, 0, 0, image_rmse(image, reference), image.total_samples(), elapsed.count()});
+            std::fprintf(stderr, "%-28s %10.3f RMSE\n", name.c_str(), results.back().rmse);
+        }
+    }
+}
+
+void write_json() {
+#ifdef RT_USE_FLOAT
+    const char* precision = "float";
+#else
+    const char* precision = "double";
+#endif
+#ifdef RT_SIMD_VEC3
+    const char* backend = "simd";
+#else
+    const char* backend = "scalar";
+#endif
+
+    std::printf("{\n  \"real\": \"%s\",\n  \"vec3\": \"%s\",\n  \"compiler\": \"%s\",\n  \"benchmarks\": [\n",
+                precision, backend, __VERSION__);
+
+    for (size_t k = 0; k < results.size(); ++k) {
+        const auto& r = results[k];
+        std::printf("    {\"name\": \"%s\", ", r.name.c_str());
+        if (r.rmse > 0)
+            std::printf("\"rmse\": %.4f, \"samples\": %ld, ", r.rmse, r.ops);
+        else if (r.mrays_per_s > 0)
+            std::printf("\"mrays_per_s\": %.4f, \"rays\": %ld, ", r.mrays_per_s, r.ops);
+        else
+            std::printf("\"ns_per_op\": %.4f, \"ops\": %ld, ", r.ns_per_op, r.ops);
+        std::printf("\"seconds\": %.4f}%s\n", r.seconds, k + 1 < results.size() ? "," : "");
+    }
+
+    std::printf("  ]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+
+    bool quick = false;
+    bool convergence = false;
+    int threads = 0;
+    for (int k = 1; k < argc; ++k) {
+        if (std::strcmp(argv[k], "--quick") == 0)
+            quick = true;
+        else if (std::strcmp(argv[k], "--convergence") == 0)
+            convergence = true;
+        else if (std::strcmp(argv[k], "--threads") == 0 && k + 1 < argc)
+            threads = std::atoi(argv[++k]);
+    }
+
+    if (quick)
+        min_seconds = 0.02;
+
+    // The same inputs on every run
+    seed_random(1);
+
+    bench_sphere();
+    bench_scene_sizes();
+    bench_scatter();
+    bench_camera_and_rng();
+    bench_end_to_end(threads, quick);
+    if (convergence)
+        bench_convergence(threads, quick);
+
+    write_json();
+}
\ No newline at end of file
@@ -0,0 +1,211 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+/*Bounding volume hierarchy. The objects are stored in a binary tree where every node holds the box around its
+children. A ray that misses the box of a node skips the whole subtree, so for well-split trees a ray only tests
+O(log n) objects instead of the n objects of hittable_list::hit.
+
+The tree is built top-down with the surface area heuristic (SAH): among the candidate splits of a node we pick the one
+that minimizes the expected cost of a ray, area(left)*n_left + area(right)*n_right. See:
+https://pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/Bounding_Volume_Hierarchies*/
+
+// What the builder needs to know about each object
+struct bvh_primitive {
+    aabb box;
+    point3 centroid;
+    size_t index;       // Position of the object in the original list
+};
+
+inline std::vector<bvh_primitive> make_bvh_primitives(const std::vector<shared_ptr<hittable>>& objects) {
+    std::vector<bvh_primitive> prims(objects.size());
+
+    for (size_t k = 0; k < objects.size(); ++k) {
+        if (!objects[k]->bounding_box(prims[k].box))
+            throw std::invalid_argument("No bounding box in bvh_node constructor.");
+
+        prims[k].centroid = prims[k].box.centroid();
+        prims[k].index = k;
+    }
+
+    return prims;
+}
+
+inline aabb bounds_of(const std::vector<bvh_primitive>& prims, size_t start, size_t end) {
+    aabb box = prims[start].box;
+    for (size_t k = start+1; k < end; ++k)
+        box = surrounding_box(box, prims[k].box);
+
+    return box;
+}
+
+// Result of sah_partition: the children are [start, mid) and [mid, end), split along axis. cost is the SAH cost of
+// the split relative to the parent, to be compared with end-start (the cost of testing every object).
+struct sah_split {
+    size_t mid;
+    int axis;
+    double cost;
+};
+
+// Binned SAH: the centroids are dropped into sah_bins slabs along each axis and only the planes between slabs are
+// tried. Reorders prims[start, end) so that the children are contiguous.
+const int sah_bins = 16;
+
+inline sah_split sah_partition(std::vector<bvh_primitive>& prims, size_t start, size_t end) {
+
+    // Bounds of the centroids, the bins divide this box
+    aabb centroid_box(prims[start].centroid, prims[start].centroid);
+    for (size_t k = start+1; k < end; ++k)
+        centroid_box = surrounding_box(centroid_box, aabb(prims[k].centroid, prims[k].centroid));
+
+    auto parent_area = bounds_of(prims, start, end).surface_area();
+
+    int best_axis = -1;
+    int best_bin = 0;
+    double cost = infinity;
+
+    for (int axis = 0; axis < 3; ++axis) {
+        auto lo = centroid_box.min()[axis];
+        auto extent = centroid_box.max()[axis] - lo;
+        if (extent <= 0) continue;                          // Every centroid on the same plane, nothing to split
+
+        auto bin_of = [&](const bvh_primitive& p) {
+            int b = static_cast<int>(sah_bins * (p.centroid[axis] - lo) / extent);
+            return b < sah_bins ? b : sah_bins-1;
+        };
+
+        int count[sah_bins] = {};
+        aabb bounds[sah_bins];
+        for (size_t k = start; k < end; ++k) {
+            int b = bin_of(prims[k]);
+            bounds[b] = count[b] ? surrounding_box(bounds[b], prims[k].box) : prims[k].box;
+            count[b]++;
+        }
+
+        // Sweep from the right to get the area and count on the right of each plane, then from the left
+        double right_area[sah_bins];
+        int right_count[sah_bins];
+        aabb acc;
+        int n = 0;
+        for (int b = sah_bins-1; b > 0; --b) {
+            if (count[b]) acc = n ? surrounding_box(acc, bounds[b]) : bounds[b];
+            n += count[b];
+            right_area[b] = n ? acc.surface_area() : 0;
+            right_count[b] = n;
+        }
+
+        n = 0;
+        for (int b = 0; b < sah_bins-1; ++b) {
+            if (count[b]) acc = n ? surrounding_box(acc, bounds[b]) : bounds[b];
+            n += count[b];
+            if (n == 0 || right_count[b+1] == 0) continue;
+
+            auto split_cost = 1.0 + (acc.surface_area()*n + right_area[b+1]*right_count[b+1]) / parent_area;
+            if (split_cost < cost) {
+                cost = split_cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+
+    // All the centroids coincide: any split is as good as another, cut in half
+    if (best_axis < 0)
+        return {start + (end - start)/2, 0, static_cast<double>(end - start)};
+
+    auto lo = centroid_box.min()[best_axis];
+    auto extent = centroid_box.max()[best_axis] - lo;
+    auto mid = std::partition(prims.begin() + start, prims.begin() + end, [&](const bvh_primitive& p) {
+        int b = static_cast<int>(sah_bins * (p.centroid[best_axis] - lo) / extent);
+        return (b < sah_bins ? b : sah_bins-1) <= best_bin;
+    });
+
+    return {static_cast<size_t>(mid - prims.begin()), best_axis, cost};
+}
+
+class bvh_node : public hittable {
+    public:
+        bvh_node() {}
+
+        // Drop-in replacement for the list: bvh_node world(random_scene());
+        bvh_node(const hittable_list& list) : bvh_node(list.objects) {}
+
+        bvh_node(const std::vector<shared_ptr<hittable>>& objects) {
+            if (objects.empty())
+                throw std::invalid_argument("Empty list in bvh_node constructor.");
+
+            auto prims = make_bvh_primitives(objects);
+            build(objects, prims, 0, prims.size());
+        }
+
+        bvh_node(const std::vector<shared_ptr<hittable>>& objects,
+                 std::vector<bvh_primitive>& prims, size_t start, size_t end) {
+            build(objects, prims, start, end);
+        }
+
+        virtual bool hit(
+            const ray& r, real t_min, real t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override;
+
+    public:
+        shared_ptr<hittable> left;
+        shared_ptr<hittable> right;
+        aabb box;
+
+    private:
+        void build(const std::vector<shared_ptr<hittable>>& objects,
+                   std::vector<bvh_primitive>& prims, size_t start, size_t end);
+};
+
+inline void bvh_node::build(const std::vector<shared_ptr<hittable>>& objects,
+                            std::vector<bvh_primitive>& prims, size_t start, size_t end) {
+
+    size_t object_span = end - start;
+
+    // With one object both children point to it, so hit() never needs to check for a missing child
+    if (object_span == 1) {
+        left = right = objects[prims[start].index];
+    } else if (object_span == 2) {
+        left = objects[prims[start].index];
+        right = objects[prims[start+1].index];
+    } else {
+        auto split = sah_partition(prims, start, end);
+
+        left = make_shared<bvh_node>(objects, prims, start, split.mid);
+        right = make_shared<bvh_node>(objects, prims, split.mid, end);
+    }
+
+    aabb box_left, box_right;
+    left->bounding_box(box_left);
+    right->bounding_box(box_right);
+
+    box = surrounding_box(box_left, box_right);
+}
+
+inline bool bvh_node::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+
+    if (!box.hit(r, t_min, t_max))
+        return false;
+
+    // If the left child is hit, the right one only matters if it is hit closer
+    bool hit_left = left->hit(r, t_min, t_max, rec);
+    bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+
+    return hit_left || hit_right;
+}
+
+inline bool bvh_node::bounding_box(aabb& output_box) const {
+    output_box = box;
+    return true;
+}
+
+#endif
\ No newline at end of file
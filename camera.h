@@ -9,10 +9,10 @@ class camera {
             point3 lookfrom,                        // Camera position
             point3 lookat,                          // Direction where we point the camera
             vec3   vup,                             // Fixed an orientator for the camera, since we can still rotate it around the vector which has lookfrom and lookat as endpoints
-            double vfov,                            // vertical field-of-view in degrees
-            double aspect_ratio,
-            double aperture,                        // The apertura gives a defocus blur/depth of view effect, simulating a more real behaviour
-            double focus_dist
+            real vfov,                              // vertical field-of-view in degrees
+            real aspect_ratio,
+            real aperture,                          // The apertura gives a defocus blur/depth of view effect, simulating a more real behaviour
+            real focus_dist
         ) {
 
             // Viewport dimensions and field of view
@@ -34,7 +34,7 @@ class camera {
             lens_radius = aperture / 2;
         }
 
-        ray get_ray(double s, double t) const {
+        ray get_ray(real s, real t) const {
             vec3 rd = lens_radius * random_in_unit_disk();
             vec3 offset = u * rd.x() + v * rd.y();
 
@@ -51,7 +51,22 @@ class camera {
         vec3 horizontal;
         vec3 vertical;
         vec3 u, v, w;
-        double lens_radius;
+        real lens_radius;
+};
+
+// The arguments of the constructor, kept together so they can be stored, e.g. in a scene file (see scene_file.h)
+struct camera_settings {
+    point3 lookfrom = point3(0, 0, 0);
+    point3 lookat = point3(0, 0, -1);
+    vec3 vup = vec3(0, 1, 0);
+    real vfov = 90;
+    real aspect_ratio = real(16.0 / 9.0);
+    real aperture = 0;
+    real focus_dist = 1;
+
+    camera make_camera() const {
+        return camera(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist);
+    }
 };
 
 #endif
\ No newline at end of file
@@ -6,7 +6,7 @@
 #include <iostream>
 
 // Displays the colors in RGB format
-void write_color_old(std::ostream &out, color pixel_color) {
+inline void write_color_old(std::ostream &out, const color& pixel_color) {
     
     // Write the translated [0,255] value of each color component.
     out << static_cast<int>(255.999 * pixel_color.x()) << ' '
@@ -14,7 +14,7 @@ void write_color_old(std::ostream &out, color pixel_color) {
         << static_cast<int>(255.999 * pixel_color.z()) << '\n';
 }
 
-void write_color(std::ostream &out, color pixel_color, int samples_per_pixel) {
+inline void write_color(std::ostream &out, const color& pixel_color, int samples_per_pixel) {
     auto r = pixel_color.x();
     auto g = pixel_color.y();
     auto b = pixel_color.z();
@@ -0,0 +1,205 @@
+#ifndef COMPILED_SCENE_H
+#define COMPILED_SCENE_H
+
+#include "rtweekend.h"
+
+#include "arena.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+/*Compiled scene.
+
+random_scene builds the world with one make_shared per sphere and per material: about a thousand small allocations
+spread over the heap, each with its reference count. Compiling copies everything the renderer reads into a single
+arena block (see arena.h), in the order the traversal reads it:
+
+    nodes       the flattened BVH of linear_bvh.h
+    spheres     center, radius and material index of each sphere, in the order of the leaves
+    materials   each distinct material once, and the table of pointers the indices refer to
+
+After that the hittable_list can be dropped. Materials of other classes than those of material.h (the custom kind)
+cannot be copied, since their size is unknown: the compiled scene shares them instead, and the renderer calls them
+through the virtual scatter. The compiled scene is never modified, so all the render threads read it
+without any locking, and destroying it frees one block instead of a thousand objects.
+
+The nodes and the spheres hold no pointers, so they can be saved as they are and mapped back from a file without any
+fixing up (see scene_file.h). The scene then points into the mapping and only the materials go in the arena.*/
+
+// A sphere as stored in the compiled scene
+struct packed_sphere {
+    point3 center;
+    real radius;
+    uint32_t material;      // Index in the material table
+};
+
+// Same computation as sphere::hit
+inline bool hit_packed_sphere(const packed_sphere& s, const material* const* materials,
+                              const ray& r, real t_min, real t_max, hit_record& rec) {
+
+    vec3 oc = r.origin() - s.center;
+    auto a = r.direction().length_squared();
+    auto half_b = dot(oc, r.direction());
+    auto c = oc.length_squared() - s.radius*s.radius;
+
+    auto discriminant = half_b*half_b - a*c;
+    if (discriminant < 0) return false;
+    auto sqrtd = sqrt(discriminant);
+
+    auto root = (-half_b - sqrtd) / a;
+    if (root < t_min || t_max < root) {
+        root = (-half_b + sqrtd) / a;
+        if (root < t_min || t_max < root)
+            return false;
+    }
+
+    rec.t = root;
+    rec.p = r.at(rec.t);
+    vec3 outward_normal = (rec.p - s.center) / s.radius;
+    rec.set_face_normal(r, outward_normal);
+    rec.mat_ptr = materials[s.material];
+
+    return true;
+}
+
+class compiled_scene : public hittable {
+    public:
+        // Every object of the list must be a sphere
+        compiled_scene(const hittable_list& list) {
+            linear_bvh bvh(list);
+
+            // Distinct materials, numbered in order of first use
+            std::unordered_map<const material*, uint32_t> indices;
+            std::vector<const material*> distinct;
+            std::vector<std::shared_ptr<const material>> owners;
+            for (const auto& object : bvh.objects) {
+                auto s = std::dynamic_pointer_cast<sphere>(object);
+                if (!s)
+                    throw std::invalid_argument("Object that is not a sphere in compiled_scene constructor.");
+                if (indices.emplace(s->mat_ptr.get(), static_cast<uint32_t>(distinct.size())).second) {
+                    distinct.push_back(s->mat_ptr.get());
+                    owners.push_back(s->mat_ptr);
+                }
+            }
+
+            reserve(bvh.nodes.size() * sizeof(linear_bvh_node) + bvh.objects.size() * sizeof(packed_sphere),
+                    distinct.size());
+
+            node_count = bvh.nodes.size();
+            auto tree = memory.make_array<linear_bvh_node>(node_count);
+            std::copy(bvh.nodes.begin(), bvh.nodes.end(), tree);
+            nodes = tree;
+
+            // Zeroed first, so the padding is zero too when the scene is saved
+            sphere_count = bvh.objects.size();
+            auto packed = memory.make_array<packed_sphere>(sphere_count);
+            std::memset(static_cast<void*>(packed), 0, sphere_count * sizeof(packed_sphere));
+            spheres = packed;
+
+            for (size_t k = 0; k < sphere_count; ++k) {
+                auto s = std::static_pointer_cast<sphere>(bvh.objects[k]);
+                packed[k].center = s->center;
+                packed[k].radius = s->radius;
+                packed[k].material = indices[s->mat_ptr.get()];
+            }
+
+            compile_materials(distinct, owners);
+        }
+
+        // Scene whose nodes and spheres live in storage (e.g. a mapped file), which it keeps alive. The materials are
+        // copied, and the material indices of the spheres refer to their order
+        compiled_scene(const linear_bvh_node* scene_nodes, size_t scene_node_count,
+                       const packed_sphere* scene_spheres, size_t scene_sphere_count,
+                       const std::vector<const material*>& scene_materials, std::shared_ptr<const void> storage,
+                       size_t storage_size)
+            : nodes(scene_nodes), spheres(scene_spheres), node_count(scene_node_count),
+              sphere_count(scene_sphere_count), external(std::move(storage)), external_bytes(storage_size) {
+
+            if (node_count == 0)
+                throw std::invalid_argument("Empty scene in compiled_scene constructor.");
+
+            reserve(0, scene_materials.size());
+            compile_materials(scene_materials, {});
+        }
+
+        bool hit_primitive(uint32_t k, const ray& r, real t_min, real t_max, hit_record& rec) const {
+            return hit_packed_sphere(spheres[k], materials, r, t_min, t_max, rec);
+        }
+
+        virtual bool hit(
+            const ray& r, real t_min, real t_max, hit_record& rec) const override {
+
+            return traverse_linear_bvh(nodes, r, t_min, t_max, rec,
+                [this](uint32_t k, const ray& r, real t_min, real t_max, hit_record& rec) {
+                    return hit_primitive(k, r, t_min, t_max, rec);
+                });
+        }
+
+        virtual bool bounding_box(aabb& output_box) const override {
+            output_box = aabb(point3(nodes[0].bounds_min[0], nodes[0].bounds_min[1], nodes[0].bounds_min[2]),
+                              point3(nodes[0].bounds_max[0], nodes[0].bounds_max[1], nodes[0].bounds_max[2]));
+            return true;
+        }
+
+        // Bytes taken by the scene, and the blocks holding them (a mapped file counts as one)
+        size_t memory_footprint() const { return memory.bytes_used() + external_bytes; }
+        size_t memory_reserved() const { return memory.bytes_reserved() + external_bytes; }
+        size_t memory_blocks() const { return memory.block_count() + (external ? 1 : 0); }
+
+    public:
+        const linear_bvh_node* nodes;       // Depth-first order, the root is nodes[0]
+        const packed_sphere* spheres;       // Leaf order
+        const material* const* materials;   // Indexed by packed_sphere::material
+        size_t node_count;
+        size_t sphere_count;
+        size_t material_count;
+
+    private:
+        // Sizes the arena for bytes of nodes and spheres, plus the materials
+        void reserve(size_t bytes, size_t material_total) {
+            const size_t material_size = std::max({sizeof(lambertian), sizeof(metal), sizeof(dielectric)});
+            memory = arena(bytes + material_total * (material_size + sizeof(const material*))
+                           + 4 * arena::block_alignment);
+        }
+
+        // Copies the materials into the arena, with their table. owners, empty or one per material, holds the custom
+        // materials, which are shared rather than copied
+        void compile_materials(const std::vector<const material*>& distinct,
+                               const std::vector<std::shared_ptr<const material>>& owners) {
+            material_count = distinct.size();
+            auto table = memory.make_array<const material*>(material_count);
+            for (size_t k = 0; k < material_count; ++k)
+                table[k] = compile_material(*distinct[k], owners.empty() ? nullptr : owners[k]);
+            materials = table;
+        }
+
+        // Copy of m in the arena, or m itself, kept alive by owner, if it is a custom material
+        const material* compile_material(const material& m, const std::shared_ptr<const material>& owner) {
+            switch (m.kind) {
+                case material_kind::lambertian: return memory.make<lambertian>(static_cast<const lambertian&>(m));
+                case material_kind::metal:      return memory.make<metal>(static_cast<const metal&>(m));
+                case material_kind::dielectric: return memory.make<dielectric>(static_cast<const dielectric&>(m));
+                default:
+                    if (!owner)
+                        throw std::invalid_argument("Custom material without an owner in compiled_scene constructor.");
+                    custom_materials.push_back(owner);
+                    return owner.get();
+            }
+        }
+
+        arena memory;
+        std::shared_ptr<const void> external;   // Holds the nodes and spheres when they are not in the arena
+        std::vector<std::shared_ptr<const material>> custom_materials;  // Shared, not copied
+        size_t external_bytes = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,193 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "rtweekend.h"
+
+#include "aov.h"
+#include "framebuffer.h"
+#include "render.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*Edge-avoiding à-trous denoiser.
+
+Noise falls as 1/sqrt(samples): halving it costs 4 times the render. Most of the noise of a path traced image is in
+flat, smoothly lit regions, where averaging nearby pixels removes it; the difficulty is to stop at the edges. Here the
+auxiliary buffers of aov.h tell where they are: a neighbour only counts if it has about the same normal, depth and
+albedo, and about the same color.
+
+The filter is the à-trous ("with holes") wavelet of Dammertz et al., Edge-Avoiding À-Trous Wavelet Transform for fast
+Global Illumination Filtering (HPG 2010): a 5x5 B-spline kernel applied iterations times, with its taps step = 2^k
+pixels apart at iteration k. Five iterations cover 125 pixels across at the cost of 5 x 25 taps per pixel. Each tap
+is weighted by exp(-d^2 / sigma^2) for each of its differences d with the center pixel:
+
+    normal      length of the difference of the normals
+    depth       relative to the larger of the two depths
+    albedo      length of the difference of the albedos
+
+and by exp(-d / (sigma sqrt(variance))) for the difference d of the square roots of the illumination (like the gamma
+of the image), relative to the noise of the pixel as in SVGF (Schied et al., Spatiotemporal Variance-Guided
+Filtering, HPG 2017). Without the sample variances, the noise is estimated from the neighbours on the same surface,
+and each iteration carries it on to the next, where it is lower.
+
+The image is divided by the albedo before filtering and multiplied back after (demodulation), so the filter only
+blurs the illumination and the colors and textures of the surfaces stay sharp.
+
+Compared with a render of many more samples, a denoised image at a low sample count has an error close to that of a
+render with several times its samples, in a fraction of the time: the AOVs take a few first hits per pixel and the
+filter a few passes over the image. The error is mostly left on the silhouettes, which mix two surfaces and are filtered
+little; the flat regions of the denoised image are as smooth as those of a render with many more samples. The filter
+estimates the noise from the image itself, so it also blurs some real detail: it is meant for low sample counts, not for
+finished renders.*/
+
+struct denoise_settings {
+    int iterations = 5;
+    double sigma_color = 0.5;       // Relative to the noise of the pixel
+    double sigma_normal = 0.5;
+    double sigma_depth = 0.3;
+    double sigma_albedo = 0.3;
+};
+
+const int variance_radius = 3;          // The noise of a pixel is estimated over 7 x 7 pixels
+
+// Replaces the pixels of image by their denoised average, keeping the sample counts. image and aovs must be whole
+// images. The threads and tiles are those of settings
+inline void denoise(framebuffer& image, const aov_buffers& aovs, const render_settings& settings,
+                    const denoise_settings& denoising = denoise_settings()) {
+
+    const int width = image.width;
+    const int height = image.height;
+    if (image.x0 != 0 || image.y0 != 0 || aovs.albedo.width != width || aovs.albedo.height != height)
+        throw std::invalid_argument("Framebuffer or AOVs of the wrong size in denoise.");
+
+    const size_t pixels = static_cast<size_t>(width) * height;
+    std::vector<color> albedo(pixels), normal(pixels), illumination(pixels), filtered(pixels);
+    std::vector<real> depth(pixels);
+
+    auto average = [](const framebuffer& f, size_t p) {
+        return f.samples[p] > 0 ? f.pixels[p] / f.samples[p] : color(0, 0, 0);
+    };
+
+    // The albedo is clamped away from 0 so the division stays finite: a black surface gets its illumination back
+    const real min_albedo = 0.01;
+    for (size_t p = 0; p < pixels; ++p) {
+        albedo[p] = average(aovs.albedo, p);
+        normal[p] = average(aovs.normal, p);
+        depth[p] = average(aovs.depth, p).x();
+
+        auto c = average(image, p);
+        illumination[p] = color(c.x() / fmax(albedo[p].x(), min_albedo), c.y() / fmax(albedo[p].y(), min_albedo),
+                                c.z() / fmax(albedo[p].z(), min_albedo));
+    }
+
+    // The filter runs on the whole image, quietly, whatever the region and control of the render
+    render_settings whole = settings;
+    render_control quiet;
+    whole.region = tile{0, 0, width, height};
+    whole.control = &quiet;
+    whole.stats = nullptr;
+
+    auto root = [](const color& c) {
+        return color(sqrt(fmax(c.x(), real(0))), sqrt(fmax(c.y(), real(0))), sqrt(fmax(c.z(), real(0))));
+    };
+
+    const real normal_scale = 1 / (denoising.sigma_normal * denoising.sigma_normal);
+    const real depth_scale = 1 / (denoising.sigma_depth * denoising.sigma_depth);
+    const real albedo_scale = 1 / (denoising.sigma_albedo * denoising.sigma_albedo);
+
+    // exp of minus the sum of the squared differences of the AOVs of p and q, each relative to its sigma
+    auto geometry_weight = [&](size_t p, size_t q) {
+        auto larger_depth = fmax(depth[p], depth[q]);
+        auto depth_difference = larger_depth > 0 ? (depth[p] - depth[q]) / larger_depth : 0;
+
+        return exp(-(normal_scale * (normal[q] - normal[p]).length_squared()
+                     + depth_scale * depth_difference * depth_difference
+                     + albedo_scale * (albedo[q] - albedo[p]).length_squared()));
+    };
+
+    // Noise of each pixel: the variance of its neighbours on the same surface, which also counts the real changes
+    // of the illumination, so it errs on the side of keeping them. Their mean is a less noisy guide for the colors
+    // compared by the first iteration
+    std::vector<real> variance(pixels), next_variance(pixels);
+    std::vector<color> guide(pixels);
+    render_tiles(whole, [&](const tile& t) {
+        for (int j = t.y0; j < t.y1; ++j) {
+            for (int i = t.x0; i < t.x1; ++i) {
+                size_t p = static_cast<size_t>(j) * width + i;
+
+                color sum, squares;
+                real weights = 0;
+                for (int y = std::max(0, j - variance_radius); y <= std::min(height - 1, j + variance_radius); ++y) {
+                    for (int x = std::max(0, i - variance_radius); x <= std::min(width - 1, i + variance_radius); ++x) {
+                        size_t q = static_cast<size_t>(y) * width + x;
+                        auto w = geometry_weight(p, q);
+                        auto r = root(illumination[q]);
+                        sum += w * r;
+                        squares += w * r * r;
+                        weights += w;
+                    }
+                }
+
+                auto mean = sum / weights;
+                guide[p] = mean;
+                auto spread = squares / weights - mean * mean;
+                variance[p] = fmax(spread.x(), real(0)) + fmax(spread.y(), real(0)) + fmax(spread.z(), real(0));
+            }
+        }
+    });
+
+    static const real kernel[5] = {1.0/16, 1.0/4, 3.0/8, 1.0/4, 1.0/16};
+
+    for (int k = 0; k < denoising.iterations; ++k) {
+        const int step = 1 << k;
+
+        render_tiles(whole, [&](const tile& t) {
+            for (int j = t.y0; j < t.y1; ++j) {
+                for (int i = t.x0; i < t.x1; ++i) {
+                    size_t p = static_cast<size_t>(j) * width + i;
+                    auto root_p = k == 0 ? guide[p] : root(illumination[p]);
+                    auto color_scale = 1 / (denoising.sigma_color * sqrt(variance[p]) + real(1e-4));
+
+                    color sum;
+                    real weights = 0, variances = 0;
+                    for (int dy = -2; dy <= 2; ++dy) {
+                        int y = j + dy * step;
+                        if (y < 0 || y >= height)
+                            continue;
+
+                        for (int dx = -2; dx <= 2; ++dx) {
+                            int x = i + dx * step;
+                            if (x < 0 || x >= width)
+                                continue;
+
+                            size_t q = static_cast<size_t>(y) * width + x;
+                            auto w = kernel[dx+2] * kernel[dy+2] * geometry_weight(p, q)
+                                   * exp(-color_scale * ((k == 0 ? guide[q] : root(illumination[q])) - root_p).length());
+                            sum += w * illumination[q];
+                            weights += w;
+                            variances += w * w * variance[q];
+                        }
+                    }
+
+                    // The center tap always weighs kernel[2]^2, so weights > 0
+                    filtered[p] = sum / weights;
+                    next_variance[p] = variances / (weights * weights);
+                }
+            }
+        });
+
+        std::swap(illumination, filtered);
+        std::swap(variance, next_variance);
+    }
+
+    for (size_t p = 0; p < pixels; ++p) {
+        auto n = image.samples[p];
+        image.pixels[p] = n * (illumination[p] * color(fmax(albedo[p].x(), min_albedo), fmax(albedo[p].y(), min_albedo),
+                                                       fmax(albedo[p].z(), min_albedo)));
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,638 @@
+#include "distributed.h"
+
+#include "packet.h"
+#include "scenes.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Every message is a header followed by size bytes of payload, in the byte order of the machines (all the same)
+enum class message_type : uint32_t { hello = 1, frame, tile, result, quit };
+
+struct message_header {
+    uint32_t type;
+    uint32_t size;
+};
+
+const uint32_t protocol_version = 2;
+
+// Worker to coordinator, once connected
+struct hello_message {
+    uint32_t version;
+    uint32_t real_size;
+    int32_t threads;
+};
+
+// Coordinator to worker, before the first tile of a frame. Followed by the name of the scene
+struct frame_message {
+    uint32_t frame;
+    int32_t image_width;
+    int32_t image_height;
+    int32_t samples_per_pixel;
+    int32_t max_depth;
+    int32_t tile_size;
+    int32_t integrator;
+    int32_t packet_size;
+    int32_t sampler;
+    int32_t pad;
+    uint64_t seed;
+    double camera[13];
+};
+
+// Coordinator to worker, and at the start of the result, followed by the sums (3 reals) and the sample counts
+// (int32) of the pixels of the tile, row after row from the bottom
+struct tile_message {
+    uint32_t frame;
+    uint32_t id;
+    int32_t x0, y0, x1, y1;
+};
+
+const size_t max_message_size = 1u << 30;
+
+// Socket address: unix:PATH, or HOST:PORT
+struct socket_address {
+    sockaddr_storage storage;
+    socklen_t length;
+    std::string unix_path;
+};
+
+socket_address parse_address(const std::string& address, bool listening) {
+    socket_address out = {};
+
+    if (address.compare(0, 5, "unix:") == 0) {
+        sockaddr_un un = {};
+        un.sun_family = AF_UNIX;
+        out.unix_path = address.substr(5);
+        if (out.unix_path.empty() || out.unix_path.size() >= sizeof(un.sun_path))
+            throw std::runtime_error("Bad Unix socket path: " + address);
+        std::memcpy(un.sun_path, out.unix_path.c_str(), out.unix_path.size() + 1);
+        std::memcpy(&out.storage, &un, sizeof(un));
+        out.length = sizeof(un);
+        return out;
+    }
+
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw std::runtime_error("Address without a port: " + address);
+    auto host = address.substr(0, colon);
+    auto port = address.substr(colon + 1);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0 || !found)
+        throw std::runtime_error("Cannot resolve " + address);
+
+    std::memcpy(&out.storage, found->ai_addr, found->ai_addrlen);
+    out.length = found->ai_addrlen;
+    freeaddrinfo(found);
+    return out;
+}
+
+void set_no_delay(int fd, const socket_address& address) {
+    if (address.storage.ss_family == AF_INET) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+}
+
+// Writes all of data, waiting when the socket is full. False if the connection is gone
+bool write_all(int fd, const void* data, size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        auto n = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                pollfd p = {fd, POLLOUT, 0};
+                poll(&p, 1, -1);
+                continue;
+            }
+            return false;
+        }
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads exactly size bytes from a blocking socket. False at the end of the connection
+bool read_all(int fd, void* data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+    while (size > 0) {
+        auto n = recv(fd, bytes, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool send_message(int fd, message_type type, const void* a, size_t a_size, const void* b = nullptr,
+                  size_t b_size = 0, const void* c = nullptr, size_t c_size = 0) {
+    message_header header = {static_cast<uint32_t>(type), static_cast<uint32_t>(a_size + b_size + c_size)};
+    return write_all(fd, &header, sizeof(header)) && write_all(fd, a, a_size)
+        && (b_size == 0 || write_all(fd, b, b_size)) && (c_size == 0 || write_all(fd, c, c_size));
+}
+
+// Whether a worker can render tiles of the frame. Anything else is another protocol, or garbage: a frame render()
+// would refuse, or a tile size make_tiles can't cut the image with, is turned away before its scene is loaded
+bool valid_frame(const frame_message& f) {
+    if (f.image_width <= 0 || f.image_height <= 0 || f.samples_per_pixel <= 0 || f.max_depth <= 0
+        || f.tile_size <= 0)
+        return false;
+
+    // The integrators and samplers a tile can be rendered with
+    if (f.integrator < static_cast<int32_t>(integrator_kind::path)
+        || f.integrator > static_cast<int32_t>(integrator_kind::wavefront)
+        || f.sampler < static_cast<int32_t>(sampler_kind::random)
+        || f.sampler > static_cast<int32_t>(sampler_kind::blue_noise))
+        return false;
+
+    auto integrator = static_cast<integrator_kind>(f.integrator);
+    if (f.sampler != static_cast<int32_t>(sampler_kind::random) && integrator != integrator_kind::path)
+        return false;
+    return integrator != integrator_kind::packets
+        || (f.packet_size >= 1 && f.packet_size <= packet_capacity / f.packet_size);
+}
+
+size_t tile_pixels(const tile_message& t) {
+    return static_cast<size_t>(t.x1 - t.x0) * static_cast<size_t>(t.y1 - t.y0);
+}
+
+}
+
+// A worker, seen from the coordinator
+struct coordinator::connection {
+    int fd;
+    bool ready = false;                 // Said hello
+    std::chrono::steady_clock::time_point connected = std::chrono::steady_clock::now();
+    uint32_t frame_sent = 0;            // Last frame described to it
+    std::vector<char> input;            // Bytes received and not parsed yet
+    std::vector<uint32_t> holding;      // Tiles of the current frame it is rendering
+
+    ~connection() { close(fd); }
+};
+
+coordinator::coordinator(const distributed_settings& settings) : config(settings) {
+    auto address = parse_address(config.address, true);
+
+    listener = socket(address.storage.ss_family, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw std::runtime_error("Cannot create a socket for " + config.address);
+
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (!address.unix_path.empty())
+        unlink(address.unix_path.c_str());
+
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address.storage), address.length) != 0
+        || listen(listener, 64) != 0) {
+        close(listener);
+        throw std::runtime_error("Cannot listen on " + config.address + ": " + std::strerror(errno));
+    }
+
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+}
+
+coordinator::~coordinator() {
+    for (auto& w : workers)
+        send_message(w->fd, message_type::quit, nullptr, 0);
+    workers.clear();
+    close(listener);
+
+    if (config.address.compare(0, 5, "unix:") == 0)
+        unlink(config.address.c_str() + 5);
+}
+
+void coordinator::accept_workers() {
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            return;
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        if (config.address.compare(0, 5, "unix:") != 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        auto c = std::make_unique<connection>();
+        c->fd = fd;
+        workers.push_back(std::move(c));
+    }
+}
+
+// Takes the tiles of worker k back and closes its connection
+void coordinator::drop(size_t k) {
+    for (auto id : workers[k]->holding) {
+        auto& t = tiles[id];
+        if (--t.holders == 0 && !t.done)
+            pending.push_back(id);
+    }
+
+    std::cerr << "\nWorker lost, " << workers[k]->holding.size() << " tile(s) handed out again\n";
+    workers.erase(workers.begin() + static_cast<long>(k));
+}
+
+// Reads what the worker sent and stores the tiles it finished. False if the connection is gone or broken
+bool coordinator::receive(connection& c, const distributed_frame& frame, framebuffer& image) {
+    char buffer[65536];
+    while (true) {
+        auto n = recv(c.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            c.input.insert(c.input.end(), buffer, buffer + n);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            return false;
+        if (errno != EINTR)
+            break;
+    }
+
+    size_t used = 0;
+    while (c.input.size() - used >= sizeof(message_header)) {
+        message_header header;
+        std::memcpy(&header, c.input.data() + used, sizeof(header));
+        if (header.size > max_message_size)
+            return false;
+        if (c.input.size() - used - sizeof(header) < header.size)
+            break;
+
+        const char* payload = c.input.data() + used + sizeof(header);
+        used += sizeof(header) + header.size;
+
+        if (static_cast<message_type>(header.type) == message_type::hello) {
+            hello_message hello;
+            if (header.size != sizeof(hello))
+                return false;
+            std::memcpy(&hello, payload, sizeof(hello));
+            if (hello.version != protocol_version || hello.real_size != sizeof(real)) {
+                std::cerr << "\nWorker of another version or real type turned away\n";
+                return false;
+            }
+            c.ready = true;
+
+        } else if (static_cast<message_type>(header.type) == message_type::result) {
+            tile_message t;
+            if (header.size < sizeof(t))
+                return false;
+            std::memcpy(&t, payload, sizeof(t));
+
+            // Results of an earlier frame, e.g. a cancelled one, are dropped
+            if (t.frame != frame_id)
+                continue;
+
+            // The pixels go to the tile as the coordinator cut it: a result for any other rectangle is a broken or
+            // hostile worker, which could otherwise write outside the framebuffer
+            if (t.id >= tiles.size())
+                return false;
+            const tile& bounds = tiles[t.id].bounds;
+            if (t.x0 != bounds.x0 || t.y0 != bounds.y0 || t.x1 != bounds.x1 || t.y1 != bounds.y1)
+                return false;
+
+            auto pixels = tile_pixels(t);
+            if (header.size != sizeof(t) + pixels * (3 * sizeof(real) + sizeof(int32_t)))
+                return false;
+
+            auto held = std::find(c.holding.begin(), c.holding.end(), t.id);
+            if (held != c.holding.end()) {
+                c.holding.erase(held);
+                tiles[t.id].holders--;
+            }
+
+            auto& state = tiles[t.id];
+            if (state.done)
+                continue;
+
+            const char* sums = payload + sizeof(t);
+            const char* counts = sums + pixels * 3 * sizeof(real);
+            size_t p = 0;
+            for (int j = bounds.y0; j < bounds.y1; ++j) {
+                for (int i = bounds.x0; i < bounds.x1; ++i, ++p) {
+                    real sum[3];
+                    int32_t n;
+                    std::memcpy(sum, sums + p * sizeof(sum), sizeof(sum));
+                    std::memcpy(&n, counts + p * sizeof(n), sizeof(n));
+                    image.store(i, j, color(sum[0], sum[1], sum[2]), n);
+                }
+            }
+
+            state.done = true;
+            tiles_done++;
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - state.sent;
+            tile_seconds += elapsed.count();
+
+            auto control = frame.settings.control;
+            int total = static_cast<int>(tiles.size());
+            if (!control)
+                std::cerr << "\rTiles remaining: " << total - tiles_done << ' ' << std::flush;
+            else if (control->progress)
+                control->progress(tiles_done, total);
+
+        } else {
+            return false;
+        }
+    }
+
+    c.input.erase(c.input.begin(), c.input.begin() + static_cast<long>(used));
+    return true;
+}
+
+render_result coordinator::render(const distributed_frame& frame, framebuffer& image) {
+    const auto& settings = frame.settings;
+
+    if (image.width != settings.image_width || image.height != settings.image_height || image.x0 != 0 || image.y0 != 0)
+        throw std::invalid_argument("Framebuffer of the wrong size in coordinator::render.");
+    if (frame.options.integrator == integrator_kind::adaptive || frame.options.integrator == integrator_kind::progressive)
+        throw std::invalid_argument("Adaptive or progressive render in coordinator::render.");
+
+    using clock = std::chrono::steady_clock;
+
+    frame_id++;
+    tiles.clear();
+    for (const auto& t : make_tiles(render_region(settings), config.tile_size)) {
+        tile_state state;
+        state.bounds = t;
+        tiles.push_back(state);
+    }
+
+    // Handed out in image order, so pending is reversed
+    pending.clear();
+    for (size_t k = tiles.size(); k-- > 0;)
+        pending.push_back(static_cast<uint32_t>(k));
+    tiles_done = 0;
+    tile_seconds = 0;
+
+    for (auto& w : workers)
+        w->holding.clear();
+
+    frame_message description = {};
+    description.frame = frame_id;
+    description.image_width = settings.image_width;
+    description.image_height = settings.image_height;
+    description.samples_per_pixel = settings.samples_per_pixel;
+    description.max_depth = settings.max_depth;
+    description.tile_size = settings.tile_size;
+    description.integrator = static_cast<int32_t>(frame.options.integrator);
+    description.packet_size = frame.options.packet_size;
+    description.sampler = static_cast<int32_t>(frame.options.sampler);
+    description.seed = settings.seed;
+    const camera_settings& v = frame.view;
+    double camera[13] = {v.lookfrom.x(), v.lookfrom.y(), v.lookfrom.z(), v.lookat.x(), v.lookat.y(), v.lookat.z(),
+                         v.vup.x(), v.vup.y(), v.vup.z(), v.vfov, v.aspect_ratio, v.aperture, v.focus_dist};
+    std::memcpy(description.camera, camera, sizeof(camera));
+
+    auto last_worker = clock::now();
+    bool waiting_said = false;
+
+    while (tiles_done < static_cast<int>(tiles.size())) {
+        if (settings.control && settings.control->cancelled())
+            return render_result::cancelled;
+
+        // Wait for new workers or results
+        std::vector<pollfd> polled;
+        polled.push_back({listener, POLLIN, 0});
+        for (auto& w : workers)
+            polled.push_back({w->fd, POLLIN, 0});
+        poll(polled.data(), polled.size(), 100);
+
+        if (polled[0].revents & POLLIN)
+            accept_workers();
+
+        for (size_t k = polled.size() - 1; k > 0; --k)
+            if (polled[k].revents && !receive(*workers[k-1], frame, image))
+                drop(k-1);
+
+        // A connection that doesn't say hello in time is not a worker, and must not keep the frame waiting
+        for (size_t k = workers.size(); k-- > 0;) {
+            std::chrono::duration<double> silent = clock::now() - workers[k]->connected;
+            if (!workers[k]->ready && silent.count() > config.hello_timeout)
+                drop(k);
+        }
+
+        // Only workers that said hello count as connected
+        auto ready = [](const std::unique_ptr<connection>& w) { return w->ready; };
+        if (std::none_of(workers.begin(), workers.end(), ready)) {
+            std::chrono::duration<double> alone = clock::now() - last_worker;
+            if (alone.count() > config.worker_timeout)
+                throw std::runtime_error("No worker connected to " + config.address);
+            if (!waiting_said && alone.count() > 1) {
+                std::cerr << "\nWaiting for workers on " << config.address << '\n';
+                waiting_said = true;
+            }
+            continue;
+        }
+        last_worker = clock::now();
+
+        // Hand out tiles to the workers that have room
+        double mean_tile = tiles_done > 0 ? tile_seconds / tiles_done : 0;
+        for (size_t k = 0; k < workers.size();) {
+            auto& w = *workers[k];
+            if (!w.ready) {
+                ++k;
+                continue;
+            }
+
+            bool sent = true;
+            while (static_cast<int>(w.holding.size()) < config.tiles_in_flight) {
+                // Next tile to render, or else a tile a slow worker has had for too long
+                long chosen = -1;
+                while (!pending.empty() && chosen < 0) {
+                    auto id = pending.back();
+                    pending.pop_back();
+                    if (!tiles[id].done && tiles[id].holders == 0)
+                        chosen = id;
+                }
+
+                if (chosen < 0 && mean_tile > 0 && w.holding.empty()) {
+                    auto now = clock::now();
+                    for (size_t id = 0; id < tiles.size() && chosen < 0; ++id) {
+                        std::chrono::duration<double> age = now - tiles[id].sent;
+                        if (!tiles[id].done && tiles[id].holders == 1 && age.count() > config.slow_factor * mean_tile)
+                            chosen = static_cast<long>(id);
+                    }
+                }
+
+                if (chosen < 0)
+                    break;
+
+                auto& state = tiles[static_cast<size_t>(chosen)];
+                tile_message t = {frame_id, static_cast<uint32_t>(chosen),
+                                  state.bounds.x0, state.bounds.y0, state.bounds.x1, state.bounds.y1};
+
+                if (w.frame_sent != frame_id) {
+                    sent = send_message(w.fd, message_type::frame, &description, sizeof(description),
+                                        frame.scene.data(), frame.scene.size());
+                    w.frame_sent = frame_id;
+                }
+                sent = sent && send_message(w.fd, message_type::tile, &t, sizeof(t));
+
+                if (state.holders == 0)
+                    state.sent = clock::now();
+                state.holders++;
+                w.holding.push_back(t.id);
+
+                if (!sent)
+                    break;
+            }
+
+            // A worker that can't be written to is dropped, and the next one moves to k
+            if (sent)
+                ++k;
+            else
+                drop(k);
+        }
+    }
+
+    return render_result::completed;
+}
+
+loaded_scene load_named_scene(const std::string& name) {
+    if (name.compare(0, 7, "random:") == 0) {
+        seed_random(std::strtoull(name.c_str() + 7, nullptr, 10));
+        return loaded_scene{compiled_scene(random_scene()), random_scene_view(3.0 / 2.0)};
+    }
+    return load_scene(name);
+}
+
+void run_worker(const std::string& address, int threads) {
+    auto target = parse_address(address, false);
+
+    int fd = socket(target.storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&target.storage), target.length) != 0) {
+        if (fd >= 0)
+            close(fd);
+        throw std::runtime_error("Cannot connect to " + address + ": " + std::strerror(errno));
+    }
+    set_no_delay(fd, target);
+
+    render_settings settings;
+    settings.threads = threads;
+    hello_message hello = {protocol_version, sizeof(real), render_threads(settings)};
+    send_message(fd, message_type::hello, &hello, sizeof(hello));
+
+    // Neither progress nor cancellation, but a control keeps render() quiet
+    render_control quiet;
+    settings.control = &quiet;
+
+    std::unique_ptr<loaded_scene> scene;
+    std::string scene_name;
+    frame_message frame = {};
+    render_options options;
+    std::unique_ptr<camera> cam;
+    std::vector<char> payload;
+
+    message_header header;
+    while (read_all(fd, &header, sizeof(header))) {
+        if (header.size > max_message_size)
+            break;
+        payload.resize(header.size);
+        if (!read_all(fd, payload.data(), payload.size()))
+            break;
+
+        auto type = static_cast<message_type>(header.type);
+        if (type == message_type::quit)
+            break;
+
+        if (type == message_type::frame && payload.size() >= sizeof(frame)) {
+            std::memcpy(&frame, payload.data(), sizeof(frame));
+            std::string name(payload.data() + sizeof(frame), payload.size() - sizeof(frame));
+            if (!valid_frame(frame)) {
+                std::cerr << "Frame that can't be rendered, disconnecting\n";
+                break;
+            }
+
+            // The scene stays loaded for the next frames. One that can't be loaded ends the connection, not the
+            // process
+            if (!scene || name != scene_name) {
+                scene.reset();
+                try {
+                    scene = std::make_unique<loaded_scene>(load_named_scene(name));
+                } catch (const std::exception& e) {
+                    std::cerr << "Cannot load the scene of the frame (" << e.what() << "), disconnecting\n";
+                    break;
+                }
+                scene_name = name;
+            }
+
+            const double* c = frame.camera;
+            camera_settings view;
+            view.lookfrom = point3(c[0], c[1], c[2]);
+            view.lookat = point3(c[3], c[4], c[5]);
+            view.vup = vec3(c[6], c[7], c[8]);
+            view.vfov = static_cast<real>(c[9]);
+            view.aspect_ratio = static_cast<real>(c[10]);
+            view.aperture = static_cast<real>(c[11]);
+            view.focus_dist = static_cast<real>(c[12]);
+            cam = std::make_unique<camera>(view.make_camera());
+
+            settings.image_width = frame.image_width;
+            settings.image_height = frame.image_height;
+            settings.samples_per_pixel = frame.samples_per_pixel;
+            settings.max_depth = frame.max_depth;
+            settings.tile_size = frame.tile_size;
+            settings.seed = frame.seed;
+            options.integrator = static_cast<integrator_kind>(frame.integrator);
+            options.packet_size = frame.packet_size;
+            options.sampler = static_cast<sampler_kind>(frame.sampler);
+
+        } else if (type == message_type::tile && payload.size() == sizeof(tile_message) && scene) {
+            tile_message t;
+            std::memcpy(&t, payload.data(), sizeof(t));
+
+            settings.region = tile{t.x0, t.y0, t.x1, t.y1};
+            if (settings.region.empty() || t.x0 < 0 || t.y0 < 0 || t.x1 > settings.image_width
+                || t.y1 > settings.image_height)
+                break;
+            framebuffer image(t.x1 - t.x0, t.y1 - t.y0, t.x0, t.y0);
+            try {
+                ::render(scene->world, *cam, settings, image, options);
+            } catch (const std::exception& e) {
+                std::cerr << "Cannot render the tile (" << e.what() << "), disconnecting\n";
+                break;
+            }
+
+            // Sums and sample counts, in the order of tile_message
+            auto pixels = tile_pixels(t);
+            std::vector<real> sums(3 * pixels);
+            std::vector<int32_t> counts(pixels);
+            for (size_t p = 0; p < pixels; ++p) {
+                for (int k = 0; k < 3; ++k)
+                    sums[3*p + k] = image.pixels[p][k];
+                counts[p] = image.samples[p];
+            }
+
+            if (!send_message(fd, message_type::result, &t, sizeof(t), sums.data(), sums.size() * sizeof(real),
+                              counts.data(), counts.size() * sizeof(int32_t)))
+                break;
+
+        } else {
+            break;
+        }
+    }
+
+    close(fd);
+}
@@ -0,0 +1,109 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "render.h"
+#include "renderer.h"
+#include "scene_file.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*Distributed rendering.
+
+A coordinator splits the frame in tiles and hands them to worker processes over sockets, TCP (HOST:PORT) or Unix
+(unix:PATH). The workers connect to the coordinator, so they can be started anywhere and at any time, even in the
+middle of a render; each one renders its tiles with all its threads, through render() and a region (see
+render_settings::region), and sends back the sums and sample counts of the pixels. The coordinator stores them in
+its framebuffer.
+
+Each pixel draws from its own random stream whichever process renders it, so the image is the same as a render on a
+single machine, and the sums travel in the renderer's own real type to keep it that way.
+
+Workers that go away (closed connection) get their tiles taken back and handed to the others. Workers that are slow
+(or hung) are dealt with at the end of the frame: once no tile is left to hand out, a tile that has been out for
+slow_factor times the mean time of a tile is also given to an idle worker, and the first result wins. A connection
+that doesn't say hello within hello_timeout is dropped, and a render with no worker that said hello for
+worker_timeout gives up.
+
+A worker loads the scene of the first frame that names it and keeps it across tiles and frames. The scene is named
+rather than sent: the path of a scene file (see scene_file.h), which the workers must be able to open, or random:SEED
+for random_scene. Coordinator and workers must be built with the same real type, which they check when connecting.
+
+See final.cpp (--coordinator, --workers and --worker) for an example.*/
+
+struct distributed_settings {
+    std::string address;            // unix:PATH, or HOST:PORT for TCP (an empty host listens on every interface)
+    int tile_size = 64;             // Side of the tiles handed to the workers
+    int tiles_in_flight = 2;        // Tiles sent to a worker before it returns the first, to hide the round trips
+    double slow_factor = 4;         // See above
+    double worker_timeout = 30;     // Seconds with no worker connected before a render gives up
+    double hello_timeout = 5;       // Seconds a connection has to say hello before it is dropped
+};
+
+// Everything the workers need to render a frame
+struct distributed_frame {
+    std::string scene;              // Path of a scene file, or random:SEED
+    camera_settings view;
+    render_settings settings;       // The threads are the workers' own. The control and stats are the coordinator's
+    render_options options;         // Neither adaptive nor progressive, which work on the whole image
+};
+
+class coordinator {
+    public:
+        // Listens on settings.address. Throws std::runtime_error if it can't
+        explicit coordinator(const distributed_settings& settings);
+
+        // Tells the workers to quit
+        ~coordinator();
+
+        coordinator(const coordinator&) = delete;
+        coordinator& operator=(const coordinator&) = delete;
+
+        // Renders frame into image, a whole image of frame.settings.image_width x image_height. Can be called for
+        // frame after frame, the workers stay connected. Progress and cancellation go through frame.settings.control,
+        // as with render(). Throws std::runtime_error if no worker shows up within worker_timeout
+        render_result render(const distributed_frame& frame, framebuffer& image);
+
+        int worker_count() const { return static_cast<int>(workers.size()); }
+
+    private:
+        struct connection;
+
+        void accept_workers();
+        bool receive(connection& c, const distributed_frame& frame, framebuffer& image);
+        void drop(size_t k);
+
+    private:
+        distributed_settings config;
+        int listener = -1;
+        std::vector<std::unique_ptr<connection>> workers;
+        uint32_t frame_id = 0;
+
+        // State of the frame being rendered
+        struct tile_state {
+            tile bounds;
+            bool done = false;
+            int holders = 0;                                    // Workers rendering it now
+            std::chrono::steady_clock::time_point sent;         // When it was first handed out
+        };
+        std::vector<tile_state> tiles;
+        std::vector<uint32_t> pending;                          // Tiles to hand out, the next at the back
+        int tiles_done = 0;
+        double tile_seconds = 0;                                // Sum of the round trips of the tiles done
+};
+
+// Connects to the coordinator at address and renders the tiles it sends with threads threads (0 uses every core),
+// until the coordinator says to quit or goes away. A message it can't use, e.g. a frame with a bad field or a scene it
+// can't load, ends the connection. Throws std::runtime_error if it can't connect
+void run_worker(const std::string& address, int threads = 0);
+
+// The scene named by distributed_frame::scene
+loaded_scene load_named_scene(const std::string& name);
+
+#endif
\ No newline at end of file
@@ -5,130 +5,373 @@
 #include "sphere.h"
 #include "camera.h"
 #include "material.h"
-
+#include "scenes.h"
+#include "compiled_scene.h"
+#include "scene_file.h"
+#include "framebuffer.h"
+#include "renderer.h"
+#include "distributed.h"
+#include "image_io.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-
-color ray_color(const ray& r, const hittable& world, int depth) {
-    
-    hit_record rec;
-
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0)
-        return color(0,0,0);
-
-    if (world.hit(r, 0.001, infinity, rec)) {
-
-        ray scattered;
-        color attenuation;
-        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered))       // Checks whether the ray is scattered, for the given object and material
-            return attenuation * ray_color(scattered, world, depth-1);
-
-        return color(0,0,0);
-    }
-
-    vec3 unit_direction = unit_vector(r.direction());
-    auto t = 0.5*(unit_direction.y() + 1.0);
-
-    return (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0);
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+Run with
+
+cmake -S . -B build && cmake --build build && ./build/final --threads 64 > final.ppm
+
+(see CMakeLists.txt for the native, LTO and profile-guided builds)
+
+--width N and --spp N change the size of the image (1200 pixels wide by default) and the samples per pixel (500).
+
+--output FILE writes the image to FILE instead of the standard output, and --format F picks its format: ppm (binary,
+the default), p3 (ASCII PPM), png or pfm (float HDR), see image_io.h. Without --format, the extension of FILE decides.
+
+--scene FILE renders the scene of FILE, in either form of scene_file.h, instead of random_scene. The image keeps the
+aspect ratio of its camera.
+
+--coordinator ADDRESS renders through worker processes, see distributed.h. ADDRESS is unix:PATH or HOST:PORT, and
+--workers N starts N workers on this machine. Other machines join with final --worker ADDRESS (and --threads N).
+For example, with 4 local workers: final --coordinator unix:/tmp/rt.sock --workers 4 --output final.ppm
+
+--threads N sets the number of worker threads (all the cores by default) and --seed S the base seed.
+The image only depends on the seed, not on the number of threads.
+--packet N traces the camera rays in packets of N x N (4, the default, or 8). 0 traces them one by one.
+--sampler S draws the random numbers of the samples from a low-discrepancy sequence, sobol or halton, or from a blue
+noise mask (blue-noise), instead of independent random numbers (random, the default), see sampler.h. It uses the
+path integrator rather than packets, or the progressive one with --progressive.
+--integrator wavefront renders with the breadth-first integrator of wavefront.h instead of ray_color (integrator.h).
+--integrator also takes path (--packet 0), packets, adaptive and progressive (--adaptive and --progressive with their
+default values).
+--adaptive T samples each pixel until its noise is below T (in [0,1] display units, e.g. 0.002), see adaptive.h.
+The total budget stays --spp samples per pixel, spent where the image is noisy.
+--stats FILE writes the statistics of the render as JSON: time and samples per second, and with a build configured
+with -DRT_STATS=ON the time of each tile and the ray, BVH, scatter and path depth counters (see stats.h).
+--sample-map FILE writes the number of samples taken by each pixel as a PGM image.
+
+--denoise N renders the albedo, normal and depth of the first surfaces with N samples per pixel (16 is a good value,
+they only need the first hit) and denoises the image with them, see denoise.h. --aov PREFIX writes these buffers to
+PREFIX.albedo.pfm, PREFIX.normal.pfm and PREFIX.depth.pfm. For example: final --spp 32 --denoise 16 --output final.png
+
+--progressive N renders in passes of N samples per pixel over the whole image, see progressive.h. --preview FILE
+writes the image after each pass, so the render can be watched and stopped (Ctrl-C) once it looks good enough; the
+image so far is then written as usual. --checkpoint FILE saves the render every --checkpoint-every seconds (60), and
+when it ends or is stopped, and resumes from FILE if it exists: the image is the same as with no interruption.
+For example: final --progressive 16 --checkpoint final.ckpt --preview preview.png --output final.png
+
+Configuring with -DRT_USE_FLOAT=ON builds the float pipeline (see rtweekend.h). Its images differ from the double
+ones by much less than the noise of a typical sample count, and the big ground sphere shows no acne. The scalar
+renderers run at the same speed, since they are limited by latency rather than bandwidth; the wavefront integrator,
+which streams its path arrays, gains a little.
+*/
+
+// Set by SIGINT and SIGTERM, see --progressive
+static std::atomic<bool> stop_requested(false);
+
+extern "C" void stop_render(int signal) {
+    stop_requested = true;
+    std::signal(signal, SIG_DFL);
 }
 
-hittable_list random_scene() {
-    hittable_list world;
-
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, ground_material));
-
-    for (int a = -11; a < 11; a++) {
-        for (int b = -11; b < 11; b++) {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
-
-            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<material> sphere_material;
-
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                } else if (choose_mat < 0.95) {
-                    // metal
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                } else {
-                    // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-            }
-        }
-    }
-
-    auto material1 = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
-
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
-
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
-
-    return world;
-}
-
-int main() {
+int main(int argc, char* argv[]) {
 
     // Image
 
+    render_settings settings;
     const auto aspect_ratio = 3.0 / 2.0;
-    const int image_width = 1200;
-    const int image_height = static_cast<int>(image_width / aspect_ratio);
-    const int samples_per_pixel = 500;
-    const int max_depth = 50;
-
-    // World
+    settings.image_width = 1200;
+    settings.samples_per_pixel = 500;
+    settings.max_depth = 50;
+    int packet_size = 4;
+    bool wavefront = false;
+    adaptive_settings adaptive;
+    bool adaptive_sampling = false;
+    sampler_kind sampling = sampler_kind::random;
+    const char* sample_map = nullptr;
+    int aov_samples = 0;
+    const char* aov_prefix = nullptr;
+    const char* output = nullptr;
+    const char* scene_path = nullptr;
+    const char* stats_path = nullptr;
+    const char* coordinator_address = nullptr;
+    const char* worker_address = nullptr;
+    int local_workers = 0;
+    render_stats stats;
+    const char* format = nullptr;
+    progressive_settings progressive;
+    bool progressive_passes = false;
+    const char* preview = nullptr;
+
+    // A typo in an option or a name (--integrator, --sampler, --format) ends with a message rather than an uncaught
+    // exception or a render with the defaults
+    image_format image_type;
+    try {
+        for (int k = 1; k < argc; k += 2) {
+            if (k + 1 == argc)
+                throw std::invalid_argument(std::string("Missing value after ") + argv[k]);
+
+            if (std::strcmp(argv[k], "--threads") == 0)
+                settings.threads = std::atoi(argv[k+1]);
+            else if (std::strcmp(argv[k], "--width") == 0)
+                settings.image_width = std::atoi(argv[k+1]);
+            else if (std::strcmp(argv[k], "--spp") == 0)
+                settings.samples_per_pixel = std::atoi(argv[k+1]);
+            else if (std::strcmp(argv[k], "--seed") == 0)
+                settings.seed = std::strtoull(argv[k+1], nullptr, 10);
+            else if (std::strcmp(argv[k], "--packet") == 0)
+                packet_size = std::atoi(argv[k+1]);
+            else if (std::strcmp(argv[k], "--sampler") == 0)
+                sampling = parse_sampler_kind(argv[k+1]);
+            else if (std::strcmp(argv[k], "--integrator") == 0) {
+                auto integrator = parse_integrator_kind(argv[k+1]);
+                wavefront = integrator == integrator_kind::wavefront;
+                adaptive_sampling = adaptive_sampling || integrator == integrator_kind::adaptive;
+                progressive_passes = progressive_passes || integrator == integrator_kind::progressive;
+                if (integrator == integrator_kind::path)
+                    packet_size = 0;
+            }
+            else if (std::strcmp(argv[k], "--adaptive") == 0) {
+                adaptive_sampling = true;
+                adaptive.threshold = std::atof(argv[k+1]);
+            }
+            else if (std::strcmp(argv[k], "--progressive") == 0) {
+                progressive_passes = true;
+                progressive.pass_samples = std::atoi(argv[k+1]);
+            }
+            else if (std::strcmp(argv[k], "--checkpoint") == 0)
+                progressive.checkpoint = argv[k+1];
+            else if (std::strcmp(argv[k], "--checkpoint-every") == 0)
+                progressive.checkpoint_interval = std::atof(argv[k+1]);
+            else if (std::strcmp(argv[k], "--preview") == 0)
+                preview = argv[k+1];
+            else if (std::strcmp(argv[k], "--denoise") == 0)
+                aov_samples = std::atoi(argv[k+1]);
+            else if (std::strcmp(argv[k], "--aov") == 0)
+                aov_prefix = argv[k+1];
+            else if (std::strcmp(argv[k], "--sample-map") == 0)
+                sample_map = argv[k+1];
+            else if (std::strcmp(argv[k], "--stats") == 0)
+                stats_path = argv[k+1];
+            else if (std::strcmp(argv[k], "--scene") == 0)
+                scene_path = argv[k+1];
+            else if (std::strcmp(argv[k], "--coordinator") == 0)
+                coordinator_address = argv[k+1];
+            else if (std::strcmp(argv[k], "--workers") == 0)
+                local_workers = std::atoi(argv[k+1]);
+            else if (std::strcmp(argv[k], "--worker") == 0)
+                worker_address = argv[k+1];
+            else if (std::strcmp(argv[k], "--output") == 0)
+                output = argv[k+1];
+            else if (std::strcmp(argv[k], "--format") == 0)
+                format = argv[k+1];
+            else
+                throw std::invalid_argument(std::string("Unknown option: ") + argv[k]);
+        }
 
-    auto world = random_scene();
+        image_type = format ? parse_image_format(format) : output ? image_format_from_path(output) : image_format::ppm;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
 
-    // Camera
+    if (sampling != sampler_kind::random && (adaptive_sampling || wavefront)) {
+        std::cerr << "--sampler works with the path and progressive integrators, not --adaptive or wavefront.\n";
+        return 1;
+    }
 
-    point3 lookfrom(13,2,3);
-    point3 lookat(0,0,0);
-    vec3 vup(0,1,0);
-    auto dist_to_focus = 10.0;
-    auto aperture = 0.1;
+    if (progressive_passes && coordinator_address) {
+        std::cerr << "--progressive renders on this machine only, not with --coordinator.\n";
+        return 1;
+    }
 
-    camera cam(lookfrom, lookat, vup, 20, aspect_ratio, aperture, dist_to_focus);
+    // A worker only needs the address, the coordinator sends the rest
+    if (worker_address) {
+        try {
+            run_worker(worker_address, settings.threads);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
 
-    // Meta data
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+    // World and camera
+
+    // The spheres go in a flattened BVH, so each ray only tests the few spheres along its path. The scene is compiled
+    // into a single block of memory (see compiled_scene.h) and the list of shared_ptr is dropped right away. A scene
+    // file in the binary form is mapped as it is, see scene_file.h
+
+    // A scene file that is missing or corrupted ends with a message as well
+    seed_random(settings.seed);
+    std::unique_ptr<loaded_scene> loaded;
+    try {
+        loaded = std::make_unique<loaded_scene>(
+            scene_path ? load_scene(scene_path)
+                       : loaded_scene{compiled_scene(random_scene()), random_scene_view(aspect_ratio)});
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    const loaded_scene& scene = *loaded;
+    const compiled_scene& world = scene.world;
+
+    std::cerr << "Scene: " << world.sphere_count << " spheres, " << world.material_count << " materials, "
+              << world.memory_footprint() << " bytes in " << world.memory_blocks() << " block(s)\n";
+
+    camera cam = scene.view.make_camera();
+
+    settings.image_height = static_cast<int>(settings.image_width / scene.view.aspect_ratio);
+
+    const int image_width = settings.image_width;
+    const int image_height = settings.image_height;
+    const int samples_per_pixel = settings.samples_per_pixel;
+
+    // Render
+
+    framebuffer image(image_width, image_height);
+
+    render_options options;
+    render_control control;
+    options.adaptive = adaptive;
+    options.packet_size = packet_size;
+    options.progressive = progressive;
+    options.sampler = sampling;
+    options.integrator = progressive_passes ? integrator_kind::progressive
+                       : adaptive_sampling ? integrator_kind::adaptive
+                       : wavefront ? integrator_kind::wavefront
+                       : packet_size > 0 && sampling == sampler_kind::random ? integrator_kind::packets
+                       : integrator_kind::path;
+
+    // A checkpoint of another render, or no worker showing up, also end with a message
+    try {
+        if (coordinator_address) {
+
+            // The tiles go to the worker processes, see distributed.h. --workers starts some on this machine
+            distributed_settings distribution;
+            distribution.address = coordinator_address;
+            std::vector<pid_t> children;
+            {
+                coordinator tiles(distribution);
+
+                for (int w = 0; w < local_workers; ++w) {
+                    pid_t pid = fork();
+                    if (pid == 0) {
+                        // The child must not unwind through the coordinator it inherited
+                        try {
+                            run_worker(coordinator_address, settings.threads);
+                        } catch (const std::exception& e) {
+                            std::cerr << e.what() << '\n';
+                            _exit(1);
+                        }
+                        _exit(0);
+                    }
+                    children.push_back(pid);
+                }
 
-    for (int j = image_height-1; j >= 0; --j) {
+                auto scene_name = scene_path ? std::string(scene_path) : "random:" + std::to_string(settings.seed);
+                tiles.render(distributed_frame{scene_name, scene.view, settings, options}, image);
+            }
 
-        std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
+            for (auto pid : children)
+                waitpid(pid, nullptr, 0);
+
+        } else {
+
+            // See renderer.cpp
+            if (stats_path)
+                settings.stats = &stats;
+
+            // Ctrl-C stops a progressive render after the tiles in flight, with a checkpoint and the image so far. A
+            // second one kills it. The callbacks run during the render, so what they share lives out here
+            int samples = 0;
+            std::mutex progress_lock;
+            if (progressive_passes) {
+                std::signal(SIGINT, stop_render);
+                std::signal(SIGTERM, stop_render);
+                control.cancel = &stop_requested;
+
+                control.progress = [&](int done, int total) {
+                    std::lock_guard<std::mutex> guard(progress_lock);
+                    std::cerr << "\rSamples per pixel: " << samples << ", tiles remaining in the pass: " << total - done
+                              << ' ' << std::flush;
+                };
+                options.progressive.pass_done = [&](const framebuffer& partial, int pass_samples) {
+                    samples = pass_samples;
+                    if (preview) {
+                        // Renamed into place, so a viewer never sees half a file
+                        auto temporary = std::string(preview) + ".tmp";
+                        {
+                            std::ofstream file(temporary, std::ios::binary);
+                            write_image(file, partial, image_format_from_path(preview));
+                        }
+                        std::rename(temporary.c_str(), preview);
+                    }
+                };
+                settings.control = &control;
+
+                if (!progressive.checkpoint.empty() && std::ifstream(progressive.checkpoint))
+                    std::cerr << "Resuming from " << progressive.checkpoint << '\n';
+            }
 
-        for (int i = 0; i < image_width; ++i) {
+            if (render(world, cam, settings, image, options) == render_result::cancelled)
+                std::cerr << "\nStopped" << (progressive.checkpoint.empty() ? "" : ", checkpoint written") << '.';
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
 
-            color pixel_color(0, 0, 0);
+    // Denoising, see denoise.h. The AOVs take a few first hits per pixel, a fraction of the time of the render
+    if (aov_samples > 0 || aov_prefix) {
+        aov_buffers aovs(image_width, image_height);
+        render_settings aov_settings = settings;
+        aov_settings.control = nullptr;
+        aov_settings.stats = nullptr;
+        render_aovs(world, cam, aov_settings, aovs, aov_samples > 0 ? aov_samples : 16);
+
+        if (aov_samples > 0)
+            denoise(image, aovs, settings);
+
+        if (aov_prefix) {
+            std::ofstream(std::string(aov_prefix) + ".albedo.pfm", std::ios::binary) << encode_pfm(aovs.albedo);
+            std::ofstream(std::string(aov_prefix) + ".normal.pfm", std::ios::binary) << encode_pfm(aovs.normal);
+            std::ofstream(std::string(aov_prefix) + ".depth.pfm", std::ios::binary) << encode_pfm(aovs.depth);
+        }
+    }
 
-            // Use many samples/rays in a single pixel to color it
-            for (int s = 0; s < samples_per_pixel; ++s) {
+    if (output) {
+        std::ofstream file(output, std::ios::binary);
+        write_image(file, image, image_type);
+    } else {
+        write_image(std::cout, image, image_type);
+    }
 
-                // Adds a random number to create an antialiasing effect. Thus, if the pixel is near the edge, we will kinda
-                // average out the colors between the two sides. E.g., if we are coloring an edge between a green and a blue surface, if random_double < 0
-                // we will have a green contribution, since we will use the ray "on the left", otherwise we will have a blue contribution. 
-                // On average, we should get some colors in-between
-                auto u = (i + random_double()) / (image_width-1);
-                auto v = (j + random_double()) / (image_height-1);
-                ray r = cam.get_ray(u, v);
-                pixel_color += ray_color(r, world, max_depth); // Colors each object in world which is hit
-            }
+    if (stats_path) {
+        std::ofstream file(stats_path);
+        stats.write_json(file);
+    }
 
-            write_color(std::cout, pixel_color, samples_per_pixel);
-        }
+    if (sample_map) {
+        std::ofstream map(sample_map);
+        image.write_sample_map(map);
     }
 
+    long pixels = static_cast<long>(image_width) * image_height;
+    std::cerr << "\nSamples: " << image.total_samples() << " (" << image.total_samples() / double(pixels)
+              << " per pixel, " << 100.0 * image.total_samples() / (pixels * samples_per_pixel) << "% of the budget)";
+
     std::cerr << "\nDone.\n";
 }
\ No newline at end of file
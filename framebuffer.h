@@ -0,0 +1,64 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+/*In-memory image shared by all the render threads. It stores the sum of the samples of each pixel and how many samples
+were taken, and it is only converted to the final [0,255] values when the image is written (see image_io.h). Every pixel belongs to
+exactly one tile, so the threads never write to the same entry and no locking is needed.
+
+A framebuffer can also hold a window of a larger image, the w x h pixels from (x0, y0): e.g. the tile a worker
+process renders in a distributed render (see distributed.h). Pixels keep the coordinates of the whole image. The
+writers of image_io.h expect a whole image.*/
+
+class framebuffer {
+    public:
+        framebuffer(int w, int h, int origin_x = 0, int origin_y = 0)
+            : width(w), height(h), x0(origin_x), y0(origin_y),
+              pixels(static_cast<size_t>(w) * h), samples(static_cast<size_t>(w) * h, 0) {}
+
+        // Pixel (i, j) with the same convention as the render loop: i grows to the right and j grows upwards
+        color& at(int i, int j) { return pixels[index(i, j)]; }
+        const color& at(int i, int j) const { return pixels[index(i, j)]; }
+
+        int& sample_count(int i, int j) { return samples[index(i, j)]; }
+        int sample_count(int i, int j) const { return samples[index(i, j)]; }
+
+        // Stores the sum of the n samples of pixel (i, j)
+        void store(int i, int j, const color& sum, int n) {
+            pixels[index(i, j)] = sum;
+            samples[index(i, j)] = n;
+        }
+
+        // Writes the number of samples of each pixel as an ASCII PGM, scaled so the busiest pixel is white
+        void write_sample_map(std::ostream &out) const {
+            int most = std::max(1, *std::max_element(samples.begin(), samples.end()));
+            out << "P2\n" << width << ' ' << height << "\n255\n";
+
+            for (int j = height-1; j >= 0; --j)
+                for (int i = 0; i < width; ++i)
+                    out << 255 * sample_count(i, j) / most << '\n';
+        }
+
+        long total_samples() const {
+            long total = 0;
+            for (auto n : samples) total += n;
+            return total;
+        }
+
+    public:
+        int width;
+        int height;
+        int x0, y0;                     // Position of the window in the image, 0 for a whole image
+        std::vector<color> pixels;      // Sum of the samples
+        std::vector<int> samples;       // Number of samples
+
+    private:
+        size_t index(int i, int j) const { return static_cast<size_t>(j - y0) * width + (i - x0); }
+};
+
+#endif
\ No newline at end of file
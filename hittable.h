@@ -3,14 +3,15 @@
 
 #include "ray.h"
 #include "rtweekend.h"
+#include "aabb.h"
 
 class material;
 
 struct hit_record {
     point3 p;
     vec3 normal;
-    shared_ptr<material> mat_ptr;   // Material property. E.g., diffuse, metal etc. This is a pointer to the class material
-    double t;
+    const material* mat_ptr;        // Material property. E.g., diffuse, metal etc. Owned by the object that was hit, see below
+    real t;
     bool front_face;                // True if hit in the front, False if hit form the back
 
     // We use this to decide wheter the object is hit from the inside or the outside
@@ -21,9 +22,17 @@ struct hit_record {
     }
 };
 
+/*Objects own their materials through shared_ptr, and the scene owns the objects. The hit record only borrows the material
+with a plain pointer: it never outlives the render, and copying a shared_ptr on every hit would mean an atomic reference
+count update that all the render threads fight over.
+
+hit() only writes rec when it returns true, so callers can pass the same record to several objects.*/
 class hittable {
     public:
-        virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const = 0;
+
+        // Box enclosing the object, used to build the BVH. Returns false if the object has no bounding box
+        virtual bool bounding_box(aabb& output_box) const = 0;
 };
 
 #endif
\ No newline at end of file
@@ -23,25 +23,25 @@ class hittable_list : public hittable {
         void add(shared_ptr<hittable> object) { objects.push_back(object); }
 
         virtual bool hit(
-            const ray& r, double t_min, double t_max, hit_record& rec) const override;
+            const ray& r, real t_min, real t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override;
 
     public:
         std::vector<shared_ptr<hittable>> objects;
 };
 
-bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+inline bool hittable_list::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
 
-    hit_record temp_rec;
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
     // The single colon is used in a range based loop: https://www.geeksforgeeks.org/range-based-loop-c/
     // See also https://stackoverflow.com/questions/221346/what-can-i-use-instead-of-the-arrow-operator for the meaning of "->"
     for (const auto& object : objects) {
-        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+        if (object->hit(r, t_min, closest_so_far, rec)) {   // rec is only overwritten by closer hits
             hit_anything = true;
-            closest_so_far = temp_rec.t;    // Returns the value of t for the intersection with the closest object so far
-            rec = temp_rec;
+            closest_so_far = rec.t;         // Returns the value of t for the intersection with the closest object so far
         }
     }
 
@@ -49,4 +49,20 @@ bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& re
     return hit_anything;
 }
 
+inline bool hittable_list::bounding_box(aabb& output_box) const {
+
+    if (objects.empty()) return false;
+
+    aabb temp_box;
+    bool first_box = true;
+
+    for (const auto& object : objects) {
+        if (!object->bounding_box(temp_box)) return false;
+        output_box = first_box ? temp_box : surrounding_box(output_box, temp_box);
+        first_box = false;
+    }
+
+    return true;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include "rtweekend.h"
+
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef RT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/*Image writers.
+
+write_color formats three integers per pixel through operator<<, which is a good part of the run time (and of the disk)
+for large images. Here the whole file is encoded in memory from the framebuffer and handed to the stream in a single
+write. The formats are:
+
+    p3   ASCII PPM, the original format (see https://en.wikipedia.org/wiki/Netpbm)
+    ppm  binary PPM (P6): the same header, then one byte per channel
+    png  PNG, compressed with zlib when built with -DRT_HAVE_ZLIB (and -lz), otherwise stored uncompressed.
+         See https://www.w3.org/TR/png/
+    pfm  Portable Float Map: linear 32-bit floats, no gamma and no clamping, for HDR post-processing.
+         See https://www.pauldebevec.com/Research/HDR/PFM/
+
+The 8-bit formats apply the same scaling, gamma and clamping as write_color.*/
+
+enum class image_format { p3, ppm, png, pfm };
+
+// Parses "p3", "ppm", "png" or "pfm"
+inline image_format parse_image_format(const std::string& name) {
+    if (name == "p3") return image_format::p3;
+    if (name == "ppm" || name == "p6") return image_format::ppm;
+    if (name == "png") return image_format::png;
+    if (name == "pfm") return image_format::pfm;
+
+    throw std::invalid_argument("Unknown image format: " + name);
+}
+
+// Format from the extension of a file name, ppm if there is none we know
+inline image_format image_format_from_path(const std::string& path) {
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos) return image_format::ppm;
+
+    auto ext = path.substr(dot + 1);
+    if (ext == "png") return image_format::png;
+    if (ext == "pfm") return image_format::pfm;
+    return image_format::ppm;
+}
+
+// Average color of pixel (i, j), before gamma
+inline color pixel_average(const framebuffer& image, int i, int j) {
+    int n = image.sample_count(i, j);
+    return n > 0 ? image.at(i, j) / n : color(0, 0, 0);
+}
+
+// Same as write_color: gamma 2 and [0,255]
+inline uint8_t to_byte(double linear) {
+    return static_cast<uint8_t>(256 * clamp(sqrt(linear), 0.0, 0.999));
+}
+
+// 8-bit RGB rows, from the top of the image to the bottom
+inline std::vector<uint8_t> rgb_bytes(const framebuffer& image) {
+    std::vector<uint8_t> rgb;
+    rgb.reserve(static_cast<size_t>(image.width) * image.height * 3);
+
+    for (int j = image.height-1; j >= 0; --j) {
+        for (int i = 0; i < image.width; ++i) {
+            auto c = pixel_average(image, i, j);
+            rgb.push_back(to_byte(c.x()));
+            rgb.push_back(to_byte(c.y()));
+            rgb.push_back(to_byte(c.z()));
+        }
+    }
+
+    return rgb;
+}
+
+inline void append(std::string& out, const void* data, size_t size) {
+    out.append(static_cast<const char*>(data), size);
+}
+
+inline std::string encode_p3(const framebuffer& image) {
+    std::string out = "P3\n" + std::to_string(image.width) + ' ' + std::to_string(image.height) + "\n255\n";
+
+    auto rgb = rgb_bytes(image);
+    for (size_t k = 0; k < rgb.size(); k += 3) {
+        out += std::to_string(rgb[k]) + ' ' + std::to_string(rgb[k+1]) + ' ' + std::to_string(rgb[k+2]) + '\n';
+    }
+
+    return out;
+}
+
+inline std::string encode_ppm(const framebuffer& image) {
+    std::string out = "P6\n" + std::to_string(image.width) + ' ' + std::to_string(image.height) + "\n255\n";
+
+    auto rgb = rgb_bytes(image);
+    append(out, rgb.data(), rgb.size());
+
+    return out;
+}
+
+inline std::string encode_pfm(const framebuffer& image) {
+
+    // A negative scale means little-endian floats
+    std::string out = "PF\n" + std::to_string(image.width) + ' ' + std::to_string(image.height) + "\n-1.0\n";
+
+    // PFM stores the bottom row first, which is our j = 0
+    std::vector<float> row(static_cast<size_t>(image.width) * 3);
+    for (int j = 0; j < image.height; ++j) {
+        for (int i = 0; i < image.width; ++i) {
+            auto c = pixel_average(image, i, j);
+            row[3*i]   = static_cast<float>(c.x());
+            row[3*i+1] = static_cast<float>(c.y());
+            row[3*i+2] = static_cast<float>(c.z());
+        }
+        append(out, row.data(), row.size() * sizeof(float));
+    }
+
+    return out;
+}
+
+// PNG helpers: the chunks are checked with a CRC-32 and the zlib stream with an Adler-32
+
+inline uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t size) {
+    static const auto table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t k = 0; k < size; ++k)
+        crc = table[(crc ^ data[k]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+inline void append_be32(std::string& out, uint32_t v) {
+    uint8_t b[4] = {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v)};
+    append(out, b, 4);
+}
+
+inline void append_png_chunk(std::string& out, const char* type, const std::string& data) {
+    append_be32(out, static_cast<uint32_t>(data.size()));
+
+    std::string body = type + data;
+    append(out, body.data(), body.size());
+    append_be32(out, crc32_update(0, reinterpret_cast<const uint8_t*>(body.data()), body.size()));
+}
+
+// zlib stream of the data
+inline std::string zlib_compress(const std::string& raw) {
+#ifdef RT_HAVE_ZLIB
+    uLongf size = compressBound(raw.size());
+    std::string out(size, '\0');
+    if (compress2(reinterpret_cast<Bytef*>(&out[0]), &size, reinterpret_cast<const Bytef*>(raw.data()), raw.size(),
+                  Z_DEFAULT_COMPRESSION) != Z_OK)
+        throw std::runtime_error("zlib compression failed");
+    out.resize(size);
+    return out;
+#else
+    // Without zlib, a valid stream of "stored" (uncompressed) deflate blocks of at most 65535 bytes
+    std::string out = "\x78\x01";
+    size_t pos = 0;
+    do {
+        auto len = static_cast<uint16_t>(std::min<size_t>(65535, raw.size() - pos));
+        bool last = pos + len == raw.size();
+        uint8_t header[5] = {uint8_t(last ? 1 : 0), uint8_t(len), uint8_t(len >> 8), uint8_t(~len), uint8_t(~len >> 8)};
+        append(out, header, 5);
+        out.append(raw, pos, len);
+        pos += len;
+    } while (pos < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (unsigned char c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    append_be32(out, (b << 16) | a);
+    return out;
+#endif
+}
+
+inline std::string encode_png(const framebuffer& image) {
+    std::string out = "\x89PNG\r\n\x1a\n";
+
+    std::string header;
+    append_be32(header, static_cast<uint32_t>(image.width));
+    append_be32(header, static_cast<uint32_t>(image.height));
+    header += std::string("\x08\x02\x00\x00\x00", 5);    // 8 bits per channel, RGB, no interlacing
+    append_png_chunk(out, "IHDR", header);
+
+    // Every row starts with its filter type. "Up" (the difference with the row above) helps the compression
+    auto rgb = rgb_bytes(image);
+    size_t stride = static_cast<size_t>(image.width) * 3;
+    std::string raw;
+    raw.reserve((stride + 1) * image.height);
+    for (int row = 0; row < image.height; ++row) {
+        const uint8_t* line = rgb.data() + row * stride;
+        raw += row == 0 ? '\0' : '\2';
+        for (size_t k = 0; k < stride; ++k)
+            raw += static_cast<char>(row == 0 ? line[k] : uint8_t(line[k] - line[k - stride]));
+    }
+
+    append_png_chunk(out, "IDAT", zlib_compress(raw));
+    append_png_chunk(out, "IEND", "");
+
+    return out;
+}
+
+// Encodes the image and writes it with a single call
+inline void write_image(std::ostream& out, const framebuffer& image, image_format format) {
+    std::string data;
+
+    switch (format) {
+        case image_format::p3:  data = encode_p3(image);  break;
+        case image_format::ppm: data = encode_ppm(image); break;
+        case image_format::png: data = encode_png(image); break;
+        case image_format::pfm: data = encode_pfm(image); break;
+    }
+
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.flush();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "material.h"
+#include "stats.h"
+
+/*Iterative path tracer.
+
+The recursive ray_color computes attenuation * ray_color(scattered, depth-1): the color of a path is the sky color
+it finally reaches times the product of the attenuations along the way. Here we keep that product (the throughput)
+in a variable and follow the path in a loop, which saves a stack frame per bounce.
+
+Paths whose throughput got small contribute little, yet they used to bounce until max_depth. With Russian roulette a
+path survives each bounce with probability p, and the survivors are divided by p. The expected color is unchanged
+(p * throughput/p + (1-p) * 0 = throughput), but most of the dim paths end early. See:
+https://pbr-book.org/3ed-2018/Monte_Carlo_Integration/Russian_Roulette_and_Splitting*/
+
+const real ray_t_min = 0.001;           // Ignores hits right at the origin of the ray, which cause shadow acne
+const int roulette_min_bounces = 3;     // Bounces before Russian roulette kicks in, so short paths are never cut
+const double roulette_max_survival = 0.95;
+
+// Color of the rays that hit nothing: a white to blue gradient
+inline color sky(const ray& r) {
+    vec3 unit_direction = unit_vector(r.direction());
+    auto t = 0.5*(unit_direction.y() + 1.0);
+
+    return (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0);
+}
+
+// Follows the path of r, whose first hit (if any) is already known, e.g. from a ray packet
+inline color trace_path(ray r, bool hit, hit_record rec, const hittable& world, int max_depth) {
+
+    color throughput(1, 1, 1);
+
+    for (int bounce = 0; bounce < max_depth; ++bounce) {
+
+        if (bounce > 0)
+            hit = world.hit(r, ray_t_min, infinity, rec);
+        RT_STAT(bounce > 0 ? local_stats().secondary_rays++ : local_stats().camera_rays++);
+
+        if (!hit) {
+            RT_STAT(count_path(bounce + 1));
+            return throughput * sky(r);
+        }
+
+        // With a sampler, each bounce draws from its own dimensions (see sampler.h)
+        ray scattered;
+        color attenuation;
+        begin_dimensions(vertex_dimension(bounce), sample_scatter_dimensions);
+        bool scattering = scatter_material(*rec.mat_ptr, r, rec, attenuation, scattered);
+        RT_STAT(count_scatter(rec.mat_ptr->kind, scattering));
+        if (!scattering) {      // Absorbed
+            RT_STAT(count_path(bounce + 1));
+            return color(0,0,0);
+        }
+
+        throughput = throughput * attenuation;
+
+        // Russian roulette, with a survival probability that follows the brightest channel of the throughput
+        if (bounce + 1 >= roulette_min_bounces) {
+            auto p = fmin(roulette_max_survival, fmax(throughput.x(), fmax(throughput.y(), throughput.z())));
+            begin_dimensions(vertex_dimension(bounce) + sample_scatter_dimensions, 1);
+            if (random_double() >= p) {
+                RT_STAT(count_path(bounce + 1));
+                return color(0,0,0);
+            }
+
+            throughput /= p;
+        }
+
+        r = scattered;
+    }
+
+    // If we've exceeded the ray bounce limit, no more light is gathered.
+    RT_STAT(count_path(max_depth, true));
+    return color(0,0,0);
+}
+
+inline color ray_color(const ray& r, const hittable& world, int max_depth) {
+
+    if (max_depth <= 0)
+        return color(0,0,0);
+
+    hit_record rec;
+    bool hit = world.hit(r, ray_t_min, infinity, rec);
+
+    return trace_path(r, hit, rec, world, max_depth);
+}
+
+#endif
\ No newline at end of file
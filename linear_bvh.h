@@ -0,0 +1,209 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "rtweekend.h"
+
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/*Compiled, flattened BVH.
+
+bvh_node is a tree of shared_ptr nodes scattered over the heap, so every step of the traversal is a likely cache miss
+and a virtual call. Here the same SAH tree (see bvh.h) is stored in a single array in depth-first order: the first
+child of a node is the next entry of the array and only the second child needs an index. Each node is 32 bytes, so two
+of them share a cache line, and the traversal is a loop with a small stack instead of recursive calls. See:
+https://pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/Bounding_Volume_Hierarchies#CompactBVHForTraversal*/
+
+struct alignas(32) linear_bvh_node {
+    float bounds_min[3];    // The box is stored in float to fit 32 bytes. It is rounded outwards, so it never shrinks
+    float bounds_max[3];
+    uint32_t offset;        // Leaf: first primitive in the ordered list. Interior node: index of the second child
+    uint16_t count;         // Number of primitives in a leaf, 0 for interior nodes
+    uint8_t axis;           // Split axis of an interior node, used to visit the nearest child first
+    uint8_t pad;
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node should be 32 bytes");
+
+const int linear_bvh_max_leaf = 4;          // Leaves with more objects are always split
+const int linear_bvh_stack_size = 64;       // The builder keeps the depth below this, see linear_bvh::build
+
+// Float bounds rounded down (for the minimum) or up (for the maximum)
+inline float round_down(double x) {
+    float f = static_cast<float>(x);
+    return f > x ? nextafterf(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+inline float round_up(double x) {
+    float f = static_cast<float>(x);
+    return f < x ? nextafterf(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+// Same slab test as aabb::hit, with the inverse of the direction computed once per ray
+inline bool hit_node_box(const linear_bvh_node& node, const point3& origin, const vec3& inv_dir,
+                         real t_min, real t_max) {
+    for (int a = 0; a < 3; a++) {
+        auto t0 = (node.bounds_min[a] - origin[a]) * inv_dir[a];
+        auto t1 = (node.bounds_max[a] - origin[a]) * inv_dir[a];
+
+        if (inv_dir[a] < 0.0)
+            std::swap(t0, t1);
+
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+
+        if (t_max <= t_min)
+            return false;
+    }
+
+    return true;
+}
+
+// Iterative traversal of a flattened BVH. hit_primitive(k, r, t_min, t_max, rec) intersects the k-th primitive of
+// the ordered list, so the same loop serves any primitive storage.
+template <typename HitPrimitive>
+bool traverse_linear_bvh(const linear_bvh_node* nodes, const ray& r, real t_min, real t_max, hit_record& rec,
+                         HitPrimitive hit_primitive) {
+
+    auto origin = r.origin();
+    auto dir = r.direction();
+    vec3 inv_dir(1.0/dir.x(), 1.0/dir.y(), 1.0/dir.z());
+    bool dir_is_neg[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+    uint32_t stack[linear_bvh_stack_size];
+    int stack_top = 0;
+    uint32_t current = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        const auto& node = nodes[current];
+        RT_STAT(local_stats().node_visits++);
+
+        if (hit_node_box(node, origin, inv_dir, t_min, t_max)) {
+            if (node.count > 0) {
+                RT_STAT(local_stats().primitive_tests += node.count);
+                for (uint32_t k = node.offset; k < node.offset + node.count; ++k) {
+                    if (hit_primitive(k, r, t_min, t_max, rec)) {
+                        hit_anything = true;
+                        t_max = rec.t;
+                    }
+                }
+            } else if (dir_is_neg[node.axis]) {
+                // The ray goes towards the second child first, leave the first one for later
+                stack[stack_top++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[stack_top++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stack_top == 0)
+            break;
+
+        current = stack[--stack_top];
+    }
+
+    return hit_anything;
+}
+
+class linear_bvh : public hittable {
+    public:
+        linear_bvh(const hittable_list& list) {
+            if (list.objects.empty())
+                throw std::invalid_argument("Empty list in linear_bvh constructor.");
+
+            auto prims = make_bvh_primitives(list.objects);
+            nodes.reserve(2 * prims.size());
+            build(prims, 0, prims.size(), 0);
+
+            // Primitives in the order of the leaves, so the objects of a leaf are next to each other
+            for (const auto& p : prims) {
+                objects.push_back(list.objects[p.index]);
+                primitives.push_back(objects.back().get());
+            }
+        }
+
+        // Intersection with the k-th primitive of the leaf order
+        bool hit_primitive(uint32_t k, const ray& r, real t_min, real t_max, hit_record& rec) const {
+            return primitives[k]->hit(r, t_min, t_max, rec);
+        }
+
+        virtual bool hit(
+            const ray& r, real t_min, real t_max, hit_record& rec) const override {
+
+            return traverse_linear_bvh(nodes.data(), r, t_min, t_max, rec,
+                [this](uint32_t k, const ray& r, real t_min, real t_max, hit_record& rec) {
+                    return hit_primitive(k, r, t_min, t_max, rec);
+                });
+        }
+
+        virtual bool bounding_box(aabb& output_box) const override {
+            const auto& root = nodes[0];
+            output_box = aabb(point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+                              point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+            return true;
+        }
+
+    public:
+        std::vector<linear_bvh_node> nodes;             // Depth-first order, the root is nodes[0]
+        std::vector<const hittable*> primitives;        // Leaf order, the pointers used by the traversal
+        std::vector<shared_ptr<hittable>> objects;      // Same order, keeps the objects alive
+
+    private:
+        // Appends the subtree of prims[start, end) and returns the index of its root
+        uint32_t build(std::vector<bvh_primitive>& prims, size_t start, size_t end, int depth) {
+
+            auto index = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+
+            auto box = bounds_of(prims, start, end);
+            for (int a = 0; a < 3; ++a) {
+                nodes[index].bounds_min[a] = round_down(box.min()[a]);
+                nodes[index].bounds_max[a] = round_up(box.max()[a]);
+            }
+
+            auto n = end - start;
+            sah_split split = {start, 0, 0};
+            if (n > 1)
+                split = sah_partition(prims, start, end);
+
+            // Leaf if splitting does not pay off
+            if (n == 1 || (n <= linear_bvh_max_leaf && split.cost >= n)) {
+                nodes[index].offset = static_cast<uint32_t>(start);
+                nodes[index].count = static_cast<uint16_t>(n);
+                return index;
+            }
+
+            // The traversal stack holds at most one entry per level. SAH trees can get lopsided, so past half the
+            // stack we switch to median splits, which add at most log2(n) more levels
+            if (depth >= linear_bvh_stack_size/2) {
+                split.mid = start + n/2;
+                std::nth_element(prims.begin() + start, prims.begin() + split.mid, prims.begin() + end,
+                    [&](const bvh_primitive& a, const bvh_primitive& b) {
+                        return a.centroid[split.axis] < b.centroid[split.axis];
+                    });
+            }
+
+            build(prims, start, split.mid, depth+1);                    // First child, right after this node
+            auto second = build(prims, split.mid, end, depth+1);
+
+            // nodes may have been reallocated by the recursive calls, so we index it again instead of keeping a reference
+            nodes[index].offset = second;
+            nodes[index].count = 0;
+            nodes[index].axis = static_cast<uint8_t>(split.axis);
+
+            return index;
+        }
+};
+
+#endif
\ No newline at end of file
@@ -3,31 +3,40 @@
 
 #include "rtweekend.h"
 
-struct hit_record;
+#include "hittable.h"
+
+#include <cstdint>
+
+/*Every material carries a tag saying which of the classes below it is. The renderer switches on the tag and calls
+scatter directly (see scatter_material), which the compiler can inline, instead of going through the virtual call.
+The three classes are final, so the tag can't lie about an override. Materials written outside this file keep the
+custom tag and are still called through the virtual scatter.*/
+enum class material_kind : uint8_t { lambertian, metal, dielectric, custom };
+
+const int material_kind_count = 4;
 
 // The material class defines the behaviour of the rays, such as in which way and how much they scatter
 class material {
     public:
+        material(material_kind k = material_kind::custom) : kind(k) {}
+
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const = 0;
+
+    public:
+        material_kind kind;
 };
 
 // Lambertinan reflection. 
-class lambertian : public material {
+class lambertian final : public material {
     public:
-        lambertian(const color& a) : albedo(a) {}
+        lambertian(const color& a) : material(material_kind::lambertian), albedo(a) {}
 
         virtual bool scatter(
-            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+            const ray&, const hit_record& rec, color& attenuation, ray& scattered
         ) const override {
-            auto scatter_direction = rec.normal + random_unit_vector(); // If this vector is the exact opposite of the normal, we have get the zero vector. This is dealt in the vec3 class
-
-            // Catch degenerate scatter direction
-            if (scatter_direction.near_zero())
-                scatter_direction = rec.normal;
-
-            scattered = ray(rec.p, scatter_direction);
+            scattered = ray(rec.p, random_cosine_direction(rec.normal));       // Cosine-weighted, see sampling.h
             attenuation = albedo;
 
             return true;
@@ -38,9 +47,9 @@ class lambertian : public material {
 };
 
 // Uses the equal-angle reflection for metals
-class metal : public material {
+class metal final : public material {
     public:
-        metal(const color& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}             // Takes fuzzy reflection into account
+        metal(const color& a, real f) : material(material_kind::metal), albedo(a), fuzz(f < 1 ? f : 1) {}             // Takes fuzzy reflection into account
 
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
@@ -54,24 +63,24 @@ class metal : public material {
 
     public:
         color albedo;
-        double fuzz;
+        real fuzz;
 
 };
 
-class dielectric : public material {
+class dielectric final : public material {
     public:
-        dielectric(double index_of_refraction) : ir(index_of_refraction) {}
+        dielectric(real index_of_refraction) : material(material_kind::dielectric), ir(index_of_refraction) {}
 
         virtual bool scatter(
             const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
         ) const override {
 
             attenuation = color(1.0, 1.0, 1.0);                         // Absorbs nothing
-            double refraction_ratio = rec.front_face ? (1.0/ir) : ir;   // Refraction index is n from the front and 1/n from the back
+            real refraction_ratio = rec.front_face ? (1/ir) : ir;       // Refraction index is n from the front and 1/n from the back
 
             vec3 unit_direction = unit_vector(r_in.direction());
-            double cos_theta = fmin(dot(-unit_direction, rec.normal), 1.0);
-            double sin_theta = sqrt(1.0 - cos_theta*cos_theta);
+            real cos_theta = fmin(dot(-unit_direction, rec.normal), real(1));
+            real sin_theta = sqrt(1 - cos_theta*cos_theta);
 
             // True if sin(theta)>1/n
             bool cannot_refract = refraction_ratio * sin_theta > 1.0;
@@ -89,10 +98,10 @@ class dielectric : public material {
         }
 
     public:
-        double ir; // Index of Refraction
+        real ir; // Index of Refraction
 
     private:
-        static double reflectance(double cosine, double ref_idx) {
+        static real reflectance(real cosine, real ref_idx) {
 
             // Use Schlick's approximation for reflectance.
             // This will, among other things, make borders much smoother
@@ -103,4 +112,20 @@ class dielectric : public material {
         }
 };
 
+// scatter of m without the virtual call for the materials of this file
+inline bool scatter_material(
+    const material& m, const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) {
+
+    switch (m.kind) {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(m).scatter(r_in, rec, attenuation, scattered);
+        case material_kind::metal:
+            return static_cast<const metal&>(m).scatter(r_in, rec, attenuation, scattered);
+        case material_kind::dielectric:
+            return static_cast<const dielectric&>(m).scatter(r_in, rec, attenuation, scattered);
+        default:
+            return m.scatter(r_in, rec, attenuation, scattered);
+    }
+}
+
 #endif
\ No newline at end of file
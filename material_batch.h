@@ -0,0 +1,95 @@
+#ifndef MATERIAL_BATCH_H
+#define MATERIAL_BATCH_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "material.h"
+#include "stats.h"
+
+#include <cstdint>
+#include <vector>
+
+/*Batched scatter.
+
+When neighbouring rays hit different materials, calling scatter ray after ray jumps between the three bodies and the
+branch predictor keeps guessing wrong. Here the hits of a batch are first split by material kind (a counting pass, no
+sort), then each kind is scattered in its own loop, where the call is resolved at compile time and inlined. Custom
+materials get a last loop through the virtual call.
+
+The batch is a structure of arrays indexed by path, as in wavefront.h. Only the paths listed in ids are scattered, and
+each one draws its random numbers from its own stream.*/
+
+struct scatter_batch {
+    const ray* rays;            // Incoming rays
+    const hit_record* rec;      // Their hits
+    rng* streams;               // Random stream of each path, advanced by the scatter
+
+    color* attenuation;         // Outputs
+    ray* scattered;
+    uint8_t* alive;             // False if the ray was absorbed
+};
+
+// Indices of the paths, by kind of the material they hit
+struct material_groups {
+    std::vector<uint32_t> ids[material_kind_count];
+
+    void clear() {
+        for (auto& g : ids) g.clear();
+    }
+
+    void add(const hit_record* rec, const std::vector<uint32_t>& paths) {
+        for (auto k : paths)
+            ids[static_cast<int>(rec[k].mat_ptr->kind)].push_back(k);
+    }
+};
+
+// Scatters the paths of ids, which all hit a material of class M (or any material if M is material)
+template <typename M>
+void scatter_group(const scatter_batch& batch, const std::vector<uint32_t>& ids) {
+    for (auto k : ids) {
+        const auto& m = static_cast<const M&>(*batch.rec[k].mat_ptr);
+
+        thread_rng() = batch.streams[k];
+        batch.alive[k] = m.scatter(batch.rays[k], batch.rec[k], batch.attenuation[k], batch.scattered[k]);
+        RT_STAT(count_scatter(m.kind, batch.alive[k]));
+        batch.streams[k] = thread_rng();
+    }
+}
+
+// The Lambertian paths draw their two uniforms path by path, then get their directions from one loop over the whole
+// group, which the compiler vectorizes (see sampling.h). Same draws and same operations as lambertian::scatter
+template <>
+inline void scatter_group<lambertian>(const scatter_batch& batch, const std::vector<uint32_t>& ids) {
+    thread_local std::vector<real> u1, u2, x, y, z;
+    const size_t n = ids.size();
+    for (auto v : {&u1, &u2, &x, &y, &z})
+        v->resize(n);
+
+    for (size_t k = 0; k < n; ++k) {
+        auto& stream = batch.streams[ids[k]];
+        u1[k] = static_cast<real>(stream.next_double());
+        u2[k] = static_cast<real>(stream.next_double());
+    }
+
+    cosine_hemisphere_batch(u1.data(), u2.data(), x.data(), y.data(), z.data(), n);
+
+    for (size_t k = 0; k < n; ++k) {
+        auto id = ids[k];
+        const auto& rec = batch.rec[id];
+        batch.scattered[id] = ray(rec.p, around_normal(rec.normal, x[k], y[k], z[k]));
+        batch.attenuation[id] = static_cast<const lambertian&>(*rec.mat_ptr).albedo;
+        batch.alive[id] = true;
+        RT_STAT(count_scatter(material_kind::lambertian, true));
+    }
+}
+
+// Scatters all the paths of the groups, one kind after the other
+inline void scatter_all(const scatter_batch& batch, const material_groups& groups) {
+    scatter_group<lambertian>(batch, groups.ids[static_cast<int>(material_kind::lambertian)]);
+    scatter_group<metal>(batch, groups.ids[static_cast<int>(material_kind::metal)]);
+    scatter_group<dielectric>(batch, groups.ids[static_cast<int>(material_kind::dielectric)]);
+    scatter_group<material>(batch, groups.ids[static_cast<int>(material_kind::custom)]);
+}
+
+#endif
\ No newline at end of file
@@ -5,33 +5,12 @@
 #include "sphere.h"
 #include "camera.h"
 #include "material.h"
+#include "scenes.h"
+#include "sphere_set.h"
+#include "integrator.h"
 
 #include <iostream>
 
-color ray_color(const ray& r, const hittable& world, int depth) {
-    
-    hit_record rec;
-
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0)
-        return color(0,0,0);
-
-    if (world.hit(r, 0.001, infinity, rec)) {
-
-        ray scattered;
-        color attenuation;
-        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered))       // Checks whether the ray is scattered, for the given object and material
-            return attenuation * ray_color(scattered, world, depth-1);
-
-        return color(0,0,0);
-    }
-
-    vec3 unit_direction = unit_vector(r.direction());
-    auto t = 0.5*(unit_direction.y() + 1.0);
-
-    return (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0);
-}
-
 int main() {
 
     // Image
@@ -42,28 +21,10 @@ int main() {
     const int max_depth = 50;
     
     // World
-    hittable_list world;
-
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0)); // Diffusive
-    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    auto material_left   = make_shared<dielectric>(1.5);                  // Refraction index is 1.5, same as glass
-    auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), .5);
-
-    world.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));  // Ground
-    world.add(make_shared<sphere>(point3( 0.0,    0.0, -1.0),   0.5, material_center));  // Middle Sphere
-    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.5, material_left));    // Left Sphere
-    world.add(make_shared<sphere>(point3( 1.0,    0.0, -1.0),   0.5, material_right));   // Right sphere
-    world.add(make_shared<sphere>(point3(-.4 ,    -.3,  0.0), -0.25, material_left));    // A hollow glass sphere. Negative radius leaves geometry unchanged but substitutes the outer material
-                                                                                         // by the inner one.
+    sphere_set world(metal_scene());  // Packed copy of the spheres, tested several at a time with SIMD
 
     // Camera
-    point3 lookfrom(3,3,2);
-    point3 lookat(0,0,-1);
-    vec3 vup(0,1,0);
-    auto dist_to_focus = (lookfrom-lookat).length();
-    auto aperture = 2.0;
-
-    camera cam(lookfrom, lookat, vup, 20, aspect_ratio, aperture, dist_to_focus);
+    camera cam = metal_scene_camera(aspect_ratio);
 
     // Meta data
     std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
@@ -0,0 +1,179 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include "rtweekend.h"
+
+#include "framebuffer.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "render.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdint>
+
+/*Packet tracing of primary rays.
+
+The camera rays of neighbouring pixels start at (almost) the same point and point in almost the same direction, so
+they cross the same BVH nodes. Instead of walking the tree once per ray, a packet of up to 8x8 rays walks it once: a
+node is opened if any ray of the packet hits its box, and the box test itself is a loop over the rays, written over
+plain arrays so the compiler can run it on SIMD lanes. Only the first hit is traced this way. The bounces after it go
+in all directions, so each ray then continues on its own.
+
+See e.g. Wald et al., "Interactive Rendering with Coherent Ray Tracing" (2001).*/
+
+const int packet_capacity = 64;     // 8x8 rays
+
+struct ray_packet {
+    int count = 0;
+
+    ray rays[packet_capacity];
+
+    // The same rays as a structure of arrays, for the box tests
+    real origin[3][packet_capacity];
+    real inv_dir[3][packet_capacity];
+
+    // Results. t_max shrinks as closer hits are found
+    real t_max[packet_capacity];
+    bool hit[packet_capacity];
+    hit_record rec[packet_capacity];
+
+    void clear() { count = 0; }
+
+    void add(const ray& r) {
+        rays[count] = r;
+        for (int a = 0; a < 3; ++a) {
+            origin[a][count] = r.origin()[a];
+            inv_dir[a][count] = 1 / r.direction()[a];
+        }
+        t_max[count] = infinity;
+        hit[count] = false;
+        count++;
+    }
+};
+
+// Slab test of every ray of the packet against the box of a node. Returns true if any ray hits it
+inline bool packet_hits_box(const linear_bvh_node& node, const ray_packet& p, real t_min, uint8_t* active) {
+    bool any = false;
+
+    for (int i = 0; i < p.count; ++i) {
+        real lo = t_min;
+        real hi = p.t_max[i];
+
+        for (int a = 0; a < 3; ++a) {
+            real t0 = (node.bounds_min[a] - p.origin[a][i]) * p.inv_dir[a][i];
+            real t1 = (node.bounds_max[a] - p.origin[a][i]) * p.inv_dir[a][i];
+            lo = std::max(lo, std::min(t0, t1));
+            hi = std::min(hi, std::max(t0, t1));
+        }
+
+        active[i] = lo < hi;
+        any |= lo < hi;
+    }
+
+    return any;
+}
+
+// Closest hit in [t_min, t_max[i]] of every ray of the packet. Bvh is a flattened BVH with nodes and hit_primitive,
+// i.e. linear_bvh or compiled_scene
+template <typename Bvh>
+void trace_packet(const Bvh& bvh, ray_packet& p, real t_min) {
+
+    if (p.count == 0) return;
+
+    // The rays are coherent, so the direction of the first one decides the near child for the whole packet
+    bool dir_is_neg[3] = {p.inv_dir[0][0] < 0, p.inv_dir[1][0] < 0, p.inv_dir[2][0] < 0};
+
+    uint32_t stack[linear_bvh_stack_size];
+    int stack_top = 0;
+    uint32_t current = 0;
+    uint8_t active[packet_capacity];
+
+    while (true) {
+        const auto& node = bvh.nodes[current];
+        RT_STAT(local_stats().node_visits++);
+
+        if (packet_hits_box(node, p, t_min, active)) {
+            if (node.count > 0) {
+                for (uint32_t k = node.offset; k < node.offset + node.count; ++k) {
+                    for (int i = 0; i < p.count; ++i) {
+                        RT_STAT(local_stats().primitive_tests += active[i]);
+                        if (active[i] && bvh.hit_primitive(k, p.rays[i], t_min, p.t_max[i], p.rec[i])) {
+                            p.hit[i] = true;
+                            p.t_max[i] = p.rec[i].t;
+                        }
+                    }
+                }
+            } else if (dir_is_neg[node.axis]) {
+                stack[stack_top++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[stack_top++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stack_top == 0)
+            break;
+
+        current = stack[--stack_top];
+    }
+}
+
+/*Renders the image in blocks of packet_size x packet_size pixels (4 or 8). For every sample, make_ray(i, j) builds the
+camera ray of each pixel of the block, the packet is traced, and shade(r, hit, rec) carries on from the first hit.
+
+Each pixel keeps its own random stream, switched in before its calls to make_ray and shade, so every pixel draws the
+same numbers in the same order as in render(): the image is the same as without packets.*/
+template <typename Bvh, typename MakeRay, typename ShadeHit>
+bool render_packets(const render_settings& settings, framebuffer& image, const Bvh& world, int packet_size,
+                    real t_min, MakeRay make_ray, ShadeHit shade) {
+
+    return render_tiles(settings, [&](const tile& t) {
+        ray_packet packet;
+        rng streams[packet_capacity];
+        color sums[packet_capacity];
+        int px[packet_capacity], py[packet_capacity];
+
+        for (int by = t.y1; by > t.y0; by -= packet_size) {
+            for (int bx = t.x0; bx < t.x1; bx += packet_size) {
+
+                // Pixels of the block, clipped to the tile
+                int n = 0;
+                for (int j = by-1; j >= std::max(t.y0, by - packet_size); --j) {
+                    for (int i = bx; i < std::min(t.x1, bx + packet_size); ++i) {
+                        px[n] = i;
+                        py[n] = j;
+                        streams[n] = rng(settings.seed, pixel_stream(settings, i, j));
+                        sums[n] = color(0, 0, 0);
+                        n++;
+                    }
+                }
+
+                for (int s = 0; s < settings.samples_per_pixel; ++s) {
+                    packet.clear();
+                    for (int k = 0; k < n; ++k) {
+                        thread_rng() = streams[k];
+                        packet.add(make_ray(px[k], py[k]));
+                        streams[k] = thread_rng();
+                    }
+
+                    trace_packet(world, packet, t_min);
+
+                    for (int k = 0; k < n; ++k) {
+                        thread_rng() = streams[k];
+                        sums[k] += shade(packet.rays[k], packet.hit[k], packet.rec[k]);
+                        streams[k] = thread_rng();
+                    }
+                }
+
+                for (int k = 0; k < n; ++k)
+                    image.store(px[k], py[k], sums[k], settings.samples_per_pixel);
+            }
+        }
+    });
+}
+
+#endif
\ No newline at end of file
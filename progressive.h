@@ -0,0 +1,199 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "rtweekend.h"
+
+#include "framebuffer.h"
+#include "render.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*Progressive rendering.
+
+Instead of finishing each pixel before moving to the next, the whole image is rendered in passes of pass_samples
+samples per pixel, added to the sums of the framebuffer. After every pass the image is complete, only noisier than
+the final one, so it can be looked at, and the render stopped once it is good enough.
+
+Every sample draws from its own random stream, picked by the pixel and the index of the sample (sample_stream). So a
+pixel with n samples only needs its sum to carry on: the next sample is n, whatever pass, process or thread takes it.
+A checkpoint is therefore just the framebuffer (sums and sample counts) and the settings and sampler it belongs to
+(the samples of two samplers don't mix), and a render resumed from one gives exactly the image the render would have
+given without the interruption. This also holds for a render cancelled in the middle of a pass, where some pixels are
+a pass ahead of the others: each pixel catches up to the target of the pass, from wherever it is.
+
+Checkpoints are written after the passes, at most every checkpoint_interval seconds, and when the render ends or is
+cancelled. They are written to a temporary file and renamed, so a render killed while writing leaves the previous
+checkpoint intact. A checkpoint can be resumed with a larger samples_per_pixel, to refine a finished render.*/
+
+struct progressive_settings {
+    int pass_samples = 8;               // Samples per pixel of each pass
+    std::string checkpoint;             // Checkpoint file. Empty for none
+    double checkpoint_interval = 60;    // Seconds between two checkpoints
+
+    // Called after each pass with the image so far and its samples per pixel, e.g. to write a preview
+    std::function<void(const framebuffer& image, int samples)> pass_done;
+};
+
+// Random stream of sample s of pixel (i, j). Streams of different samples are independent, and they do not depend on
+// samples_per_pixel, so a render can be continued to more samples
+inline uint64_t sample_stream(const render_settings& settings, int i, int j, int s) {
+    return pixel_stream(settings, i, j) + (static_cast<uint64_t>(s) << 40);
+}
+
+// Header of a checkpoint file, followed by the sums (3 reals) and the sample counts (int32) of the pixels
+struct checkpoint_header {
+    char magic[8];              // "RTCHKPT\0"
+    uint32_t version;
+    uint32_t real_size;
+    int32_t image_width;
+    int32_t image_height;
+    int32_t max_depth;
+    int32_t sampler;            // sampler_kind
+    uint64_t seed;
+};
+
+const uint32_t checkpoint_version = 2;
+
+inline checkpoint_header make_checkpoint_header(const render_settings& settings, sampler_kind sampler) {
+    checkpoint_header header = {};
+    std::memcpy(header.magic, "RTCHKPT", 8);
+    header.version = checkpoint_version;
+    header.real_size = sizeof(real);
+    header.image_width = settings.image_width;
+    header.image_height = settings.image_height;
+    header.max_depth = settings.max_depth;
+    header.sampler = static_cast<int32_t>(sampler);
+    header.seed = settings.seed;
+    return header;
+}
+
+inline void save_checkpoint(const std::string& path, const render_settings& settings, sampler_kind sampler,
+                            const framebuffer& image) {
+    auto header = make_checkpoint_header(settings, sampler);
+    auto temporary = path + ".tmp";
+
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        std::vector<real> sums(3 * image.pixels.size());
+        for (size_t p = 0; p < image.pixels.size(); ++p)
+            for (int k = 0; k < 3; ++k)
+                sums[3*p + k] = image.pixels[p][k];
+        out.write(reinterpret_cast<const char*>(sums.data()), static_cast<std::streamsize>(sums.size() * sizeof(real)));
+        out.write(reinterpret_cast<const char*>(image.samples.data()),
+                  static_cast<std::streamsize>(image.samples.size() * sizeof(int)));
+
+        if (!out)
+            throw std::runtime_error("Cannot write checkpoint " + temporary);
+    }
+
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("Cannot rename checkpoint " + temporary);
+}
+
+// Loads the checkpoint of path into image and returns true, or returns false if there is no such file. Throws
+// std::runtime_error if it belongs to another render (size, seed, max_depth, sampler or real type), is truncated or
+// is corrupt
+inline bool load_checkpoint(const std::string& path, const render_settings& settings, sampler_kind sampler,
+                            framebuffer& image) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    checkpoint_header header, expected = make_checkpoint_header(settings, sampler);
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(&header, &expected, sizeof(header)) != 0)
+        throw std::runtime_error("Checkpoint " + path + " belongs to another render.");
+
+    if (image.width != settings.image_width || image.height != settings.image_height)
+        throw std::invalid_argument("Framebuffer of the wrong size in load_checkpoint.");
+
+    std::vector<real> sums(3 * image.pixels.size());
+    in.read(reinterpret_cast<char*>(sums.data()), static_cast<std::streamsize>(sums.size() * sizeof(real)));
+    std::vector<int> counts(image.samples.size());
+    in.read(reinterpret_cast<char*>(counts.data()), static_cast<std::streamsize>(counts.size() * sizeof(int)));
+    if (!in)
+        throw std::runtime_error("Checkpoint " + path + " is truncated.");
+
+    // Nothing after the counts, and no count render_progressive could not carry on from. The image is left as it was
+    bool negative = std::any_of(counts.begin(), counts.end(), [](int n) { return n < 0; });
+    if (negative || in.peek() != std::ifstream::traits_type::eof())
+        throw std::runtime_error("Checkpoint " + path + " is corrupt.");
+
+    for (size_t p = 0; p < image.pixels.size(); ++p)
+        image.pixels[p] = color(sums[3*p], sums[3*p + 1], sums[3*p + 2]);
+    image.samples = std::move(counts);
+
+    return true;
+}
+
+// Renders with sample(i, j, s), the color of sample s of pixel (i, j), in passes, carrying on from the samples already
+// in image (e.g. from load_checkpoint) until every pixel has samples_per_pixel. sample draws its numbers with sampler,
+// which the checkpoints record. Returns false if the render was cancelled (see render_control), after writing a
+// checkpoint.
+template <typename Sample>
+bool render_progressive(const render_settings& settings, const progressive_settings& progressive, sampler_kind sampler,
+                        framebuffer& image, Sample sample) {
+
+    using clock = std::chrono::steady_clock;
+
+    // Nothing to render, and no smallest sample count to start from
+    if (image.samples.empty())
+        return true;
+
+    int done = *std::min_element(image.samples.begin(), image.samples.end());
+    auto last_checkpoint = clock::now();
+    bool completed = true;
+
+    while (done < settings.samples_per_pixel) {
+        int target = std::min(settings.samples_per_pixel, done + std::max(1, progressive.pass_samples));
+
+        completed = render_tiles(settings, [&](const tile& t) {
+            for (int j = t.y1-1; j >= t.y0; --j) {
+                for (int i = t.x0; i < t.x1; ++i) {
+                    int n = image.sample_count(i, j);
+                    if (n >= target)
+                        continue;
+
+                    // The sum goes on in the same order as in a render in one go
+                    color sum = image.at(i, j);
+                    for (int s = n; s < target; ++s) {
+                        thread_rng() = rng(settings.seed, sample_stream(settings, i, j, s));
+                        sum += sample(i, j, s);
+                    }
+                    image.store(i, j, sum, target);
+                }
+            }
+        });
+
+        if (!completed)
+            break;
+
+        done = target;
+        if (progressive.pass_done)
+            progressive.pass_done(image, done);
+
+        std::chrono::duration<double> since = clock::now() - last_checkpoint;
+        if (!progressive.checkpoint.empty() && (since.count() >= progressive.checkpoint_interval
+                                                || done == settings.samples_per_pixel)) {
+            save_checkpoint(progressive.checkpoint, settings, sampler, image);
+            last_checkpoint = clock::now();
+        }
+    }
+
+    if (!completed && !progressive.checkpoint.empty())
+        save_checkpoint(progressive.checkpoint, settings, sampler, image);
+
+    return completed;
+}
+
+#endif
\ No newline at end of file
@@ -3,24 +3,28 @@
 
 #include "vec3.h"
 
-class ray {
+// Ray with coordinates of type T, see vec3_t. The renderer uses ray = ray_t<real>
+template <typename T>
+class ray_t {
     public:
-        ray() {}
-        ray(const point3& origin, const vec3& direction)
+        ray_t() {}
+        ray_t(const vec3_t<T>& origin, const vec3_t<T>& direction)
             : orig(origin), dir(direction)
         {}
 
-        point3 origin() const  { return orig; } // A
-        vec3 direction() const { return dir; }  // b
+        vec3_t<T> origin() const  { return orig; } // A
+        vec3_t<T> direction() const { return dir; }  // b
 
         // Ray parametrization P(t) = A + b t
-        point3 at(double t) const {
+        vec3_t<T> at(T t) const {
             return orig + t*dir;
         }
 
     public:
-        point3 orig;
-        vec3 dir;
+        vec3_t<T> orig;
+        vec3_t<T> dir;
 };
 
+using ray = ray_t<real>;
+
 #endif
\ No newline at end of file
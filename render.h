@@ -0,0 +1,227 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "rtweekend.h"
+
+#include "framebuffer.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/*Parallel tile renderer.
+
+The image is split in square tiles which are handed to a pool of worker threads. Each worker starts with its own
+contiguous share of the tiles and, once it runs out of work, it steals tiles from the other workers. This way a
+worker that got an expensive region of the image (e.g. the glass spheres) does not hold back the whole render.*/
+
+// Progress and cancellation of a render, for callers that run it in-process (see renderer.h)
+struct render_control {
+    // Called after each tile with the number of tiles done so far. It runs on the worker threads, outside of any lock
+    // of the renderer, so calls from different workers may overlap and arrive out of order
+    std::function<void(int tiles_done, int tiles_total)> progress;
+
+    // Once it is true, the workers finish their current tile and stop. The pixels not rendered keep 0 samples
+    const std::atomic<bool>* cancel = nullptr;
+
+    bool cancelled() const { return cancel && cancel->load(std::memory_order_relaxed); }
+};
+
+// Pixels [x0, x1) x [y0, y1) of the image
+struct tile {
+    int x0, y0;
+    int x1, y1;
+
+    bool empty() const { return x1 <= x0 || y1 <= y0; }
+};
+
+struct render_settings {
+    int image_width = 400;
+    int image_height = 225;
+    int samples_per_pixel = 100;
+    int max_depth = 50;
+    int threads = 0;                // Number of worker threads. 0 uses every available core
+    int tile_size = 16;             // Tiles are tile_size x tile_size pixels, smaller at the borders of the image
+    uint64_t seed = 0;              // Base seed. The same seed gives the same image for any number of threads
+    const render_control* control = nullptr;    // Without it, the tiles remaining are printed on stderr
+    render_stats* stats = nullptr;              // Receives the counters of the workers, see stats.h
+
+    // Renders only these pixels of the image, e.g. the tile a process got in a distributed render (see
+    // distributed.h). The pixels draw the same random numbers as in a render of the whole image. Empty renders it all
+    tile region = {0, 0, 0, 0};
+};
+
+inline std::vector<tile> make_tiles(const tile& region, int tile_size) {
+    if (tile_size <= 0)
+        throw std::invalid_argument("Tile size must be positive in make_tiles.");
+
+    std::vector<tile> tiles;
+
+    // Top rows first, so the tiles are (roughly) finished in the same order the image is written
+    for (int y1 = region.y1; y1 > region.y0; y1 -= tile_size)
+        for (int x0 = region.x0; x0 < region.x1; x0 += tile_size)
+            tiles.push_back({x0, std::max(region.y0, y1 - tile_size), std::min(region.x1, x0 + tile_size), y1});
+
+    return tiles;
+}
+
+inline std::vector<tile> make_tiles(int width, int height, int tile_size) {
+    return make_tiles(tile{0, 0, width, height}, tile_size);
+}
+
+// The pixels settings asks for: its region, or the whole image
+inline tile render_region(const render_settings& settings) {
+    return settings.region.empty() ? tile{0, 0, settings.image_width, settings.image_height} : settings.region;
+}
+
+// Random stream used for pixel (i, j). It only depends on the pixel, not on the thread that renders it
+inline uint64_t pixel_stream(const render_settings& settings, int i, int j) {
+    return static_cast<uint64_t>(j) * settings.image_width + static_cast<uint64_t>(i);
+}
+
+// One deque of tiles per worker. The owner takes tiles from the front and thieves take them from the back,
+// so the owner keeps working on neighbouring tiles while the stolen ones are as far from it as possible.
+class tile_scheduler {
+    public:
+        tile_scheduler(const std::vector<tile>& tiles, int workers) {
+            for (int w = 0; w < workers; ++w)
+                queues.push_back(std::make_unique<tile_queue>());
+
+            // Contiguous shares: worker w gets tiles [w*n/workers, (w+1)*n/workers)
+            auto n = tiles.size();
+            for (size_t k = 0; k < n; ++k)
+                queues[k * workers / n]->tiles.push_back(tiles[k]);
+        }
+
+        // Returns false once there is no work left anywhere
+        bool next(int worker, tile& t) {
+            if (pop_front(*queues[worker], t))
+                return true;
+
+            // Steal, starting from the next worker so the thieves spread over the victims
+            int workers = static_cast<int>(queues.size());
+            for (int k = 1; k < workers; ++k)
+                if (pop_back(*queues[(worker + k) % workers], t))
+                    return true;
+
+            return false;
+        }
+
+    private:
+        struct tile_queue {
+            std::mutex lock;
+            std::deque<tile> tiles;
+        };
+
+        static bool pop_front(tile_queue& q, tile& t) {
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.tiles.empty()) return false;
+            t = q.tiles.front();
+            q.tiles.pop_front();
+            return true;
+        }
+
+        static bool pop_back(tile_queue& q, tile& t) {
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.tiles.empty()) return false;
+            t = q.tiles.back();
+            q.tiles.pop_back();
+            return true;
+        }
+
+    private:
+        std::vector<std::unique_ptr<tile_queue>> queues;     // std::mutex can't be moved, hence the unique_ptr
+};
+
+inline int render_threads(const render_settings& settings) {
+    if (settings.threads > 0)
+        return settings.threads;
+
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Calls shade_tile(t) once for every tile of the image, spread over the worker threads.
+// Returns false if the render was cancelled through settings.control, in which case some tiles were skipped.
+template <typename TileShader>
+bool render_tiles(const render_settings& settings, TileShader shade_tile) {
+
+    auto tiles = make_tiles(render_region(settings), settings.tile_size);
+    int total = static_cast<int>(tiles.size());
+    int workers = std::min(render_threads(settings), total);
+    const render_control* control = settings.control;
+
+    tile_scheduler scheduler(tiles, workers);
+    std::atomic<int> tiles_done(0);
+    std::mutex progress_lock;
+
+    auto work = [&](int worker) {
+        RT_STAT(local_stats() = thread_stats());
+        RT_STAT(std::vector<tile_stats> tile_times);
+
+        tile t;
+        while (!(control && control->cancelled()) && scheduler.next(worker, t)) {
+            RT_STAT(auto start = std::chrono::steady_clock::now());
+            shade_tile(t);
+            RT_STAT(std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start);
+            RT_STAT(tile_times.push_back({t.x0, t.y0, t.x1, t.y1, worker, elapsed.count()}));
+
+            int done = ++tiles_done;
+            if (!control) {
+                std::lock_guard<std::mutex> guard(progress_lock);
+                std::cerr << "\rTiles remaining: " << total - done << ' ' << std::flush;
+            } else if (control->progress) {
+                // Not under progress_lock: a slow callback would hold back the other workers
+                control->progress(done, total);
+            }
+        }
+
+#ifdef RT_STATS
+        // Once per worker, so the counting itself never waits
+        if (settings.stats) {
+            std::lock_guard<std::mutex> guard(progress_lock);
+            settings.stats->counters.add(local_stats());
+            settings.stats->tiles.insert(settings.stats->tiles.end(), tile_times.begin(), tile_times.end());
+        }
+#endif
+    };
+
+    // The serial path runs on the calling thread
+    if (workers == 1) {
+        work(0);
+    } else {
+        std::vector<std::thread> pool;
+        for (int w = 0; w < workers; ++w)
+            pool.emplace_back(work, w);
+
+        for (auto& thread : pool)
+            thread.join();
+    }
+
+    return tiles_done == total;
+}
+
+// Fills the framebuffer with shade_pixel(i, j), which returns the sum of the samples of pixel (i, j).
+// Each pixel draws from its own stream of random numbers, so the image only depends on settings.seed.
+template <typename PixelShader>
+bool render(const render_settings& settings, framebuffer& image, PixelShader shade_pixel) {
+
+    return render_tiles(settings, [&](const tile& t) {
+        for (int j = t.y1-1; j >= t.y0; --j) {
+            for (int i = t.x0; i < t.x1; ++i) {
+                seed_random(settings.seed, pixel_stream(settings, i, j));
+                image.store(i, j, shade_pixel(i, j), settings.samples_per_pixel);
+            }
+        }
+    });
+}
+
+#endif
\ No newline at end of file
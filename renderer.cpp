@@ -0,0 +1,115 @@
+#include "renderer.h"
+
+#include "integrator.h"
+#include "packet.h"
+#include "wavefront.h"
+
+#include <chrono>
+#include <stdexcept>
+
+// Adds a random number to create an antialiasing effect, averaging the colors of the surfaces the pixel covers
+static ray jittered_ray(const camera& cam, const render_settings& settings, int i, int j) {
+    auto u = (i + random_double()) / (settings.image_width-1);
+    auto v = (j + random_double()) / (settings.image_height-1);
+    return cam.get_ray(u, v);
+}
+
+render_result render(const compiled_scene& scene, const camera& cam, const render_settings& settings,
+                     framebuffer& image, const render_options& options) {
+
+    auto region = render_region(settings);
+    if (region.x0 < image.x0 || region.y0 < image.y0
+        || region.x1 > image.x0 + image.width || region.y1 > image.y0 + image.height)
+        throw std::invalid_argument("Framebuffer that does not cover the pixels to render in render.");
+    if (options.integrator == integrator_kind::adaptive && !settings.region.empty())
+        throw std::invalid_argument("Adaptive sampling of a region in render: it shares its budget over the image.");
+    if (options.integrator == integrator_kind::progressive && !settings.region.empty())
+        throw std::invalid_argument("Progressive render of a region in render: checkpoints hold whole images.");
+    if (options.sampler != sampler_kind::random && options.integrator != integrator_kind::path
+        && options.integrator != integrator_kind::progressive)
+        throw std::invalid_argument("Sampler in render: only the path and progressive integrators take one.");
+    if (options.integrator == integrator_kind::packets
+        && (options.packet_size < 1 || options.packet_size * options.packet_size > packet_capacity))
+        throw std::invalid_argument("Packet size out of range in render.");
+
+    const int max_depth = settings.max_depth;
+    auto camera_ray = [&](int i, int j) { return jittered_ray(cam, settings, i, j); };
+    auto source = make_sampler(options.sampler, settings.seed);
+
+    auto start = std::chrono::steady_clock::now();
+    bool completed = false;
+    switch (options.integrator) {
+        case integrator_kind::adaptive:
+            // Each call is a single sample, adaptive.h decides how many each pixel gets
+            completed = render_adaptive(settings, options.adaptive, image, [&](int i, int j) {
+                return ray_color(camera_ray(i, j), scene, max_depth);
+            });
+            break;
+
+        case integrator_kind::progressive:
+            // Passes over the whole image, see progressive.h
+            if (!options.progressive.checkpoint.empty())
+                load_checkpoint(options.progressive.checkpoint, settings, options.sampler, image);
+            completed = render_progressive(settings, options.progressive, options.sampler, image, [&](int i, int j, int s) {
+                if (source)
+                    begin_sample(source.get(), i, j, s);
+                auto sample = ray_color(camera_ray(i, j), scene, max_depth);
+                end_sample();
+                return sample;
+            });
+            break;
+
+        case integrator_kind::wavefront:
+            // All the paths of a tile advance one bounce at a time
+            completed = render_wavefront(settings, image, scene, ray_t_min, camera_ray, sky);
+            break;
+
+        case integrator_kind::packets:
+            // The camera rays of packet_size x packet_size pixels are traced together, the bounces one by one
+            completed = render_packets(settings, image, scene, options.packet_size, ray_t_min, camera_ray,
+                [&](const ray& r, bool hit, const hit_record& rec) {
+                    return trace_path(r, hit, rec, scene, max_depth);
+                });
+            break;
+
+        case integrator_kind::path:
+            completed = render(settings, image, [&](int i, int j) {
+                color pixel_color(0, 0, 0);
+                for (int s = 0; s < settings.samples_per_pixel; ++s) {
+                    if (source)
+                        begin_sample(source.get(), i, j, s);
+                    pixel_color += ray_color(camera_ray(i, j), scene, max_depth);
+                }
+                end_sample();
+                return pixel_color;
+            });
+            break;
+    }
+
+    if (settings.stats) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        settings.stats->seconds += elapsed.count();
+        settings.stats->samples += image.total_samples();
+        settings.stats->threads = render_threads(settings);
+        settings.stats->max_depth = max_depth;
+    }
+
+    return completed ? render_result::completed : render_result::cancelled;
+}
+
+render_result render_aovs(const compiled_scene& scene, const camera& cam, const render_settings& settings,
+                          aov_buffers& aovs, int samples) {
+
+    const auto& image = aovs.albedo;
+    auto region = render_region(settings);
+    if (region.x0 < image.x0 || region.y0 < image.y0
+        || region.x1 > image.x0 + image.width || region.y1 > image.y0 + image.height)
+        throw std::invalid_argument("AOVs that do not cover the pixels to render in render_aovs.");
+    if (samples < 1)
+        throw std::invalid_argument("No samples in render_aovs.");
+
+    bool completed = render_aovs(settings, aovs, samples, scene, ray_t_min,
+                                 [&](int i, int j) { return jittered_ray(cam, settings, i, j); }, sky);
+
+    return completed ? render_result::completed : render_result::cancelled;
+}
@@ -0,0 +1,78 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "compiled_scene.h"
+#include "framebuffer.h"
+#include "render.h"
+#include "adaptive.h"
+#include "progressive.h"
+#include "aov.h"
+#include "denoise.h"
+
+#include <stdexcept>
+#include <string>
+
+/*Renderer library.
+
+The headers hold the building blocks (the tile loop of render.h, the integrators of integrator.h, packet.h,
+wavefront.h and adaptive.h), which each demo used to wire together itself. render() below does that wiring once, in
+renderer.cpp, which is compiled into the rt library (see CMakeLists.txt). A program that links rt renders a scene
+in-process:
+
+    compiled_scene scene(random_scene());
+    framebuffer image(settings.image_width, settings.image_height);
+    render(scene, cam, settings, image);
+
+and reads the pixels from image, or writes them with image_io.h. Progress and cancellation go through
+settings.control (see render_control in render.h): the callback is called after each tile, and setting the cancel
+flag from another thread stops the workers after their current tile. With settings.stats, the render also returns its
+statistics (see stats.h).*/
+
+enum class integrator_kind {
+    path,           // ray_color, one pixel after the other
+    packets,        // Camera rays traced in packets, see packet.h
+    wavefront,      // Breadth-first, see wavefront.h
+    adaptive,       // ray_color with adaptive sampling, see adaptive.h
+    progressive     // ray_color in passes over the whole image, with checkpoints, see progressive.h
+};
+
+// Integrator from its name, as in the enum (e.g. on a command line)
+inline integrator_kind parse_integrator_kind(const std::string& name) {
+    if (name == "path") return integrator_kind::path;
+    if (name == "packets") return integrator_kind::packets;
+    if (name == "wavefront") return integrator_kind::wavefront;
+    if (name == "adaptive") return integrator_kind::adaptive;
+    if (name == "progressive") return integrator_kind::progressive;
+
+    throw std::invalid_argument("Unknown integrator: " + name);
+}
+
+struct render_options {
+    integrator_kind integrator = integrator_kind::packets;
+    int packet_size = 4;                // Side of the packets (4 or 8), for integrator_kind::packets
+    adaptive_settings adaptive;         // For integrator_kind::adaptive
+    progressive_settings progressive;   // For integrator_kind::progressive. Resumes from the checkpoint if there is one
+
+    // Where the samples of the path and progressive integrators draw their random numbers, see sampler.h
+    sampler_kind sampler = sampler_kind::random;
+};
+
+enum class render_result {
+    completed,
+    cancelled       // Stopped through settings.control. The pixels not rendered have 0 samples
+};
+
+// Renders scene as seen from cam into image, which must hold the pixels to render: the whole image, or a window
+// around settings.region
+render_result render(const compiled_scene& scene, const camera& cam, const render_settings& settings,
+                     framebuffer& image, const render_options& options = render_options());
+
+// Renders the albedo, normal and depth of the surfaces seen from cam, with samples samples per pixel, for denoise()
+// (see aov.h and denoise.h). aovs must hold the pixels to render, as image does for render()
+render_result render_aovs(const compiled_scene& scene, const camera& cam, const render_settings& settings,
+                          aov_buffers& aovs, int samples = 16);
+
+#endif
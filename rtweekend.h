@@ -6,12 +6,25 @@
 #include <memory>
 #include <cstdlib>
 
+#include "sampler.h"
+
 // Usings
 
 using std::shared_ptr;
 using std::make_shared;
 using std::sqrt;
 
+// Precision
+
+/*Scalar type of the geometry: vectors, rays, hit distances, camera and materials. Double by default; build with
+-DRT_USE_FLOAT for a float pipeline, which halves the memory traffic and doubles the SIMD width. Statistics, image
+accumulation in the adaptive sampler and random numbers stay in double. See final.cpp for how the two compare.*/
+#ifdef RT_USE_FLOAT
+typedef float real;
+#else
+typedef double real;
+#endif
+
 // Constants
 
 const double infinity = std::numeric_limits<double>::infinity();
@@ -25,9 +38,58 @@ inline double degrees_to_radians(double degrees) {
 
 // Random numbers generators
 
+// Each thread owns its generator (see sampler.h), so render threads never share a state. The renderer switches it to
+// the stream of every pixel before rendering it, which makes the image independent of the threads that rendered it.
+inline rng& thread_rng() {
+    thread_local rng generator;
+    return generator;
+}
+
+inline void seed_random(uint64_t seed, uint64_t stream = 0) {
+    thread_rng() = rng(seed, stream);
+}
+
+// Where random_double() draws from when a sampler is set (see the samplers of sampler.h): dimensions [dimension, end)
+// of sample n of pixel (i, j), then the rng once they are used up. Like the rng, each thread has its own
+struct sample_cursor {
+    const sampler* source = nullptr;
+    int i = 0, j = 0;
+    uint32_t n = 0;
+    int dimension = 0;
+    int end = 0;
+};
+
+inline sample_cursor& thread_sample_cursor() {
+    thread_local sample_cursor cursor;
+    return cursor;
+}
+
+// Starts sample n of pixel (i, j) with source, at the dimensions of the camera ray. The rng should be seeded as well,
+// for the draws past the dimensions of the sampler
+inline void begin_sample(const sampler* source, int i, int j, uint32_t n) {
+    thread_sample_cursor() = sample_cursor{source, i, j, n, sample_pixel_dimension, sample_vertex_dimension};
+}
+
+inline void end_sample() {
+    thread_sample_cursor() = sample_cursor();
+}
+
+// The next count draws take dimensions first to first + count - 1 of the sample, if there is a sampler
+inline void begin_dimensions(int first, int count) {
+    auto& cursor = thread_sample_cursor();
+    if (cursor.source) {
+        cursor.dimension = first;
+        cursor.end = first + count;
+    }
+}
+
 inline double random_double() {
     // Returns a random real in [0,1).
-    return rand() / (RAND_MAX + 1.0);
+    auto& cursor = thread_sample_cursor();
+    if (cursor.dimension < cursor.end)
+        return cursor.source->sample(cursor.i, cursor.j, cursor.n, cursor.dimension++);
+
+    return thread_rng().next_double();
 }
 
 inline double random_double(double min, double max) {
@@ -46,5 +108,6 @@ inline double clamp(double x, double min, double max) {
 
 #include "ray.h"
 #include "vec3.h"
+#include "sampling.h"
 
 #endif
\ No newline at end of file
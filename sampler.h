@@ -0,0 +1,334 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*Pseudo-random number generators used by the renderer.
+
+rand() keeps a single global state behind a lock, so it both serializes the render threads and gives a fairly poor
+sequence. Instead, every thread owns an xoshiro256+ generator (see https://prng.di.unimi.it/). It is a handful of
+shifts and xors per number and it passes the usual statistical tests on the upper bits, which are the only ones we use
+to build doubles.
+
+A generator is identified by a seed and a stream number. Streams are meant to be the index of a pixel or of a tile:
+the same (seed, stream) pair always gives the same sequence, and different streams are statistically independent.
+
+Independent random numbers converge slowly: the error of n samples falls as 1/sqrt(n), because nothing stops them
+from clumping. The samplers at the end of this file place the samples of a pixel evenly instead, see below.*/
+
+// SplitMix64, used to turn the (seed, stream) pair into the 256 bits of state of xoshiro.
+// See: https://rosettacode.org/wiki/Pseudo-random_numbers/Splitmix64
+constexpr uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+class rng {
+    public:
+        constexpr rng() : rng(0, 0) {}
+        constexpr rng(uint64_t seed, uint64_t stream = 0) : s{0, 0, 0, 0} {
+
+            // Mix the stream in before expanding, so nearby streams (e.g. neighbouring pixels) start far apart
+            uint64_t mixer = stream;
+            uint64_t state = seed ^ splitmix64(mixer);
+
+            for (auto& word : s)
+                word = splitmix64(state);
+        }
+
+        // Next 64 random bits
+        uint64_t next() {
+            const uint64_t result = s[0] + s[3];
+            const uint64_t t = s[1] << 17;
+
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+
+            return result;
+        }
+
+        // Random real in [0,1), built from the upper 53 bits
+        double next_double() {
+            return static_cast<double>(next() >> 11) * 0x1.0p-53;
+        }
+
+        // Independent generator for a sub-stream of this one, e.g. the pixels of a tile
+        rng split(uint64_t stream) {
+            return rng(next(), stream);
+        }
+
+    public:
+        uint64_t s[4];   // Generator state. Plain data, so it can be copied or saved as is
+
+    private:
+        static constexpr uint64_t rotl(const uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+};
+
+/*Samplers.
+
+A sample of a pixel is a path, and each random number it draws is one dimension of the sample: the position in the
+pixel, the point on the lens, then a few per bounce. A sampler gives dimension d of sample n of pixel (i, j) so that,
+over the samples of a pixel, each dimension (and each pair of consecutive ones) covers [0,1) evenly. The dimensions
+are laid out at fixed places (sample_pixel_dimension and so on), so e.g. the second bounce of every sample draws from
+the same dimensions whatever happened before it; see begin_sample and begin_dimensions in rtweekend.h, which point
+random_double() at a sampler. The materials of material.h draw a fixed count of numbers per bounce (see sampling.h);
+the draws beyond the dimensions set aside, e.g. of a custom material, come from the pixel's rng as before.
+
+    sobol       The first two dimensions of the Sobol sequence, with Owen scrambling, for every pair of dimensions.
+                Each pair shuffles the order of the samples and scrambles the values with its own seed, so the pairs
+                are independent of each other and of the other pixels, and each one is a (0,2)-sequence: every
+                power of two of samples is stratified in both dimensions. See Burley, Practical Hash-based Owen
+                Scrambling (JCGT 2020), https://jcgt.org/published/0009/04/01/
+    halton      The radical inverse of the sample number in a prime base per dimension (2, 3, 5, ...), with the
+                digits scrambled by a random permutation per pixel and dimension. The large bases of the later
+                dimensions are poorly distributed for a few samples, so the dimensions past halton_dimensions are
+                independent random numbers
+    blue_noise  A 64x64 blue noise mask, shifted by a random offset per dimension, plus the sample number times
+                an irrational step per dimension (the square root of a prime, a Kronecker sequence). The error is
+                about that of independent samples, but it is spread as high frequency noise between neighbouring
+                pixels, which looks smoother and is what a denoiser removes best. See Heitz and Belcour,
+                Distributing Monte Carlo Errors as a Blue Noise in Screen Space (EGSR 2019)
+
+The samplers are classes, so others can be plugged in by deriving from sampler.*/
+
+const int sample_pixel_dimension = 0;       // Position in the pixel, 2 dimensions
+const int sample_lens_dimension = 2;        // Point on the lens, 2 dimensions
+const int sample_vertex_dimension = 4;      // First dimension of the first bounce
+const int sample_vertex_dimensions = 4;     // Per bounce: the scatter (3 for a metal), then Russian roulette
+const int sample_scatter_dimensions = sample_vertex_dimensions - 1;
+
+// First dimension of bounce k
+inline int vertex_dimension(int bounce) {
+    return sample_vertex_dimension + bounce * sample_vertex_dimensions;
+}
+
+// Hash of the values, e.g. the coordinates of a pixel and a dimension, to 64 bits
+inline uint64_t hash_values(uint64_t a, uint64_t b, uint64_t c = 0, uint64_t d = 0) {
+    uint64_t state = a;
+    state = splitmix64(state) ^ b;
+    state = splitmix64(state) ^ c;
+    state = splitmix64(state) ^ d;
+    return splitmix64(state);
+}
+
+// Real in [0,1) from the upper 53 bits
+inline double unit_double(uint64_t bits) {
+    return static_cast<double>(bits >> 11) * 0x1.0p-53;
+}
+
+// Fractional part of x >= 0, always below 1
+inline double wrap_unit(double x) {
+    x -= std::floor(x);
+    return x < 1 ? x : 0x1.fffffffffffffp-1;
+}
+
+class sampler {
+    public:
+        virtual ~sampler() = default;
+
+        // Dimension d of sample n of pixel (i, j), in [0,1)
+        virtual double sample(int i, int j, uint32_t n, int d) const = 0;
+};
+
+class sobol_sampler final : public sampler {
+    public:
+        explicit sobol_sampler(uint64_t s) : seed(s) {}
+
+        virtual double sample(int i, int j, uint32_t n, int d) const override {
+            auto pair_seed = hash_values(seed, static_cast<uint64_t>(i), static_cast<uint64_t>(j), d / 2);
+            auto index = nested_uniform_scramble(n, static_cast<uint32_t>(pair_seed));
+            auto value = nested_uniform_scramble(sobol(index, d % 2), static_cast<uint32_t>(hash_values(pair_seed, d)));
+            return value * 0x1.0p-32;
+        }
+
+        // Dimension 0 (the van der Corput sequence) or 1 of the Sobol sequence, as 32 bits
+        static uint32_t sobol(uint32_t index, int dimension) {
+            uint32_t x = 0;
+            uint32_t direction = 1u << 31;
+            for (; index; index >>= 1) {
+                if (index & 1)
+                    x ^= direction;
+                direction = dimension == 0 ? direction >> 1 : direction ^ (direction >> 1);
+            }
+            return x;
+        }
+
+        // Owen scrambling of the bits of x, from the highest: each bit is flipped or not depending on the bits above
+        static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+            return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+        }
+
+    private:
+        static uint32_t reverse_bits(uint32_t x) {
+            x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+            x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+            x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+            x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+            return (x >> 16) | (x << 16);
+        }
+
+        // Hash where each bit only depends on the bits below it, see Burley's paper
+        static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+            x += seed;
+            x ^= x * 0x6c50b47cu;
+            x ^= x * 0xb82f1e52u;
+            x ^= x * 0xc7afe638u;
+            x ^= x * 0x8d22f6e6u;
+            return x;
+        }
+
+    private:
+        uint64_t seed;
+};
+
+const int halton_dimensions = 32;
+
+const uint32_t sampler_primes[halton_dimensions] = {
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109,
+    113, 127, 131
+};
+
+class halton_sampler final : public sampler {
+    public:
+        explicit halton_sampler(uint64_t s) : seed(s) {}
+
+        virtual double sample(int i, int j, uint32_t n, int d) const override {
+            auto scramble = hash_values(seed, static_cast<uint64_t>(i), static_cast<uint64_t>(j), d);
+            if (d >= halton_dimensions)
+                return unit_double(hash_values(scramble, n));
+
+            return scrambled_radical_inverse(n, sampler_primes[d], scramble);
+        }
+
+        // The digits of n in base b, mirrored around the point (0.d0 d1 d2...), each digit k mapped to a k + c mod b
+        // with a and c drawn from scramble. Without it, the first base samples in base b > samples per pixel would
+        // all fall in [0, samples/b). The digits past those of n (zeros) are scrambled too, down to the precision
+        // of a double, which jitters the point within its stratum
+        static double scrambled_radical_inverse(uint32_t n, uint32_t base, uint64_t scramble) {
+            double inverse_base = 1.0 / base, scale = inverse_base, x = 0;
+            while (scale > 0x1.0p-53) {
+                uint64_t digit_scramble = splitmix64(scramble);
+                uint32_t a = 1 + static_cast<uint32_t>(digit_scramble % (base - 1));
+                uint32_t c = static_cast<uint32_t>((digit_scramble >> 32) % base);
+
+                x += ((a * (n % base) + c) % base) * scale;
+                n /= base;
+                scale *= inverse_base;
+            }
+            return wrap_unit(x);
+        }
+
+    private:
+        uint64_t seed;
+};
+
+const int blue_noise_size = 64;
+
+// Ranks of the pixels of a blue noise mask of blue_noise_size x blue_noise_size, scaled to [0,1). Built once with
+// the void-and-cluster method (Ulichney 1993) from an empty pattern: each pixel in turn goes where the points placed
+// so far are the farthest (least energy, with a Gaussian of each point wrapped around the mask), so every
+// threshold of the mask is an even, clump-free set of points
+inline const std::vector<float>& blue_noise_mask() {
+    static const std::vector<float> mask = [] {
+        const int size = blue_noise_size;
+        const int count = size * size;
+        const double sigma = 1.5;
+
+        // Gaussian of the distance, wrapped around
+        std::vector<double> kernel(count);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                int dx = std::min(x, size - x), dy = std::min(y, size - y);
+                kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+            }
+        }
+
+        // A tiny random energy to start with breaks the ties, which would otherwise fill the mask in a grid
+        std::vector<double> energy(count);
+        std::vector<bool> placed(count, false);
+        uint64_t state = 1;
+        for (auto& e : energy)
+            e = 1e-9 * unit_double(splitmix64(state));
+
+        std::vector<float> ranks(count);
+        for (int rank = 0; rank < count; ++rank) {
+            int best = -1;
+            for (int p = 0; p < count; ++p)
+                if (!placed[p] && (best < 0 || energy[p] < energy[best]))
+                    best = p;
+
+            placed[best] = true;
+            ranks[best] = (rank + 0.5f) / count;
+
+            int bx = best % size, by = best / size;
+            for (int y = 0; y < size; ++y) {
+                const double* row = &kernel[((y - by + size) % size) * size];
+                for (int x = 0; x < size; ++x)
+                    energy[y * size + x] += row[(x - bx + size) % size];
+            }
+        }
+
+        return ranks;
+    }();
+
+    return mask;
+}
+
+class blue_noise_sampler final : public sampler {
+    public:
+        explicit blue_noise_sampler(uint64_t s) : seed(s), mask(blue_noise_mask()) {}
+
+        virtual double sample(int i, int j, uint32_t n, int d) const override {
+            auto offset = hash_values(seed, d);
+            int x = (i + static_cast<int>(offset % blue_noise_size)) % blue_noise_size;
+            int y = (j + static_cast<int>((offset >> 32) % blue_noise_size)) % blue_noise_size;
+
+            // Past the primes, a random step, which is irrational but for a set of measure 0
+            double step = d < halton_dimensions ? std::sqrt(static_cast<double>(sampler_primes[d]))
+                                                : unit_double(hash_values(seed, d, 1));
+            return wrap_unit(mask[y * blue_noise_size + x] + step * n);
+        }
+
+    private:
+        uint64_t seed;
+        const std::vector<float>& mask;
+};
+
+enum class sampler_kind { random, sobol, halton, blue_noise };
+
+// Parses "random", "sobol", "halton" or "blue-noise"
+inline sampler_kind parse_sampler_kind(const std::string& name) {
+    if (name == "random") return sampler_kind::random;
+    if (name == "sobol") return sampler_kind::sobol;
+    if (name == "halton") return sampler_kind::halton;
+    if (name == "blue-noise") return sampler_kind::blue_noise;
+
+    throw std::invalid_argument("Unknown sampler: " + name);
+}
+
+// The sampler of kind for a render with seed. Null for sampler_kind::random, which draws everything from the rng
+inline std::unique_ptr<sampler> make_sampler(sampler_kind kind, uint64_t seed) {
+    switch (kind) {
+        case sampler_kind::sobol:       return std::unique_ptr<sampler>(new sobol_sampler(seed));
+        case sampler_kind::halton:      return std::unique_ptr<sampler>(new halton_sampler(seed));
+        case sampler_kind::blue_noise:  return std::unique_ptr<sampler>(new blue_noise_sampler(seed));
+        default:                        return nullptr;
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,168 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "vec3.h"
+
+/*Sampling kernels: points on the unit disk, sphere and hemisphere from uniform numbers in [0,1).
+
+The book draws them by rejection: a random point of the square (or cube) until one falls inside the disk (or ball).
+Each try is a branch the CPU cannot predict, and the count of random numbers varies, which a sampler (see sampler.h)
+cannot lay out: the retries fell past the dimensions of the bounce, on plain random numbers. The kernels here map a
+fixed count of uniforms with a fixed sequence of operations and no branch (the selects are ternaries, which compile
+to blends), so they cost the same every time, vectorize, and turn evenly spread uniforms into evenly spread points:
+
+    concentric_disk         Shirley and Chiu, A Low Distortion Map Between Disk and Square (JGT 1997): the square
+                            [-1,1]^2 is mapped to the disk ring by ring, keeping the areas and little distorting the
+                            strata. 2 uniforms
+    cosine_hemisphere       The disk lifted to the hemisphere around z (Malley's method), a cosine-weighted
+                            direction. 2 uniforms
+    uniform_sphere          The disk mapped to the sphere by the same area-preserving lift, both hemispheres. 2
+                            uniforms
+    uniform_ball            A point of the sphere at radius cbrt(u). 3 uniforms
+
+The angle of the concentric map stays in [-pi/4, pi/4], where a short polynomial gives sin and cos to the last bit
+of a double, so the scalar kernels and the batches (the _batch functions, plain loops over arrays, which the
+compiler vectorizes like packet.h) give the same points. The sqrt never sees a negative argument, but GCC cannot
+tell and keeps it out of vector loops for the sake of errno, hence -fno-math-errno in CMakeLists.txt.*/
+
+// sin and cos of x in [-pi/4, pi/4], by their Taylor series up to the terms below 1e-17
+template <typename T>
+inline T quarter_sin(T x) {
+    T x2 = x * x;
+    return x * (T(1) + x2 * (T(-1.0/6) + x2 * (T(1.0/120) + x2 * (T(-1.0/5040) + x2 * (T(1.0/362880)
+           + x2 * (T(-1.0/39916800) + x2 * (T(1.0/6227020800) + x2 * T(-1.0/1307674368000))))))));
+}
+
+template <typename T>
+inline T quarter_cos(T x) {
+    T x2 = x * x;
+    return T(1) + x2 * (T(-1.0/2) + x2 * (T(1.0/24) + x2 * (T(-1.0/720) + x2 * (T(1.0/40320)
+           + x2 * (T(-1.0/3628800) + x2 * (T(1.0/479001600) + x2 * (T(-1.0/87178291200)
+           + x2 * T(1.0/20922789888000))))))));
+}
+
+// Point (x, y) of the unit disk for the uniforms u1, u2. Returns its squared distance to the center
+template <typename T>
+inline T concentric_disk(T u1, T u2, T& x, T& y) {
+    T a = 2*u1 - 1;
+    T b = 2*u2 - 1;
+
+    // In the wedges left and right of the center the radius is |a| and the angle b/a of a quarter turn, above and
+    // below the other way round. The center (a = b = 0) has radius 0, whatever its angle. a and b are in [-1, 1], so
+    // the squared radius is at most 1, rounding included, and 1 - r^2 needs no clamp before a sqrt
+    bool sideways = a*a > b*b;
+    T r = sideways ? a : b;
+    T ratio = (sideways ? b : a) / (r + T(r == 0));
+    T phi = T(pi / 4) * ratio;
+
+    T s = r * quarter_sin(phi);
+    T c = r * quarter_cos(phi);
+    x = sideways ? c : s;
+    y = sideways ? s : c;
+    return sideways ? a*a : b*b;
+}
+
+// Cosine-weighted direction (x, y, z) around +z
+template <typename T>
+inline void cosine_hemisphere(T u1, T u2, T& x, T& y, T& z) {
+    z = std::sqrt(1 - concentric_disk(u1, u2, x, y));
+}
+
+// Uniform direction (x, y, z)
+template <typename T>
+inline void uniform_sphere(T u1, T u2, T& x, T& y, T& z) {
+    T r2 = concentric_disk(u1, u2, x, y);
+    T scale = 2 * std::sqrt(1 - r2);
+    x *= scale;
+    y *= scale;
+    z = 1 - 2*r2;
+}
+
+// Uniform point (x, y, z) of the unit ball
+template <typename T>
+inline void uniform_ball(T u1, T u2, T u3, T& x, T& y, T& z) {
+    uniform_sphere(u1, u2, x, y, z);
+    T radius = std::cbrt(u3);
+    x *= radius;
+    y *= radius;
+    z *= radius;
+}
+
+// The kernels over arrays of n uniforms, one point per index
+template <typename T>
+void concentric_disk_batch(const T* u1, const T* u2, T* x, T* y, size_t n) {
+    for (size_t k = 0; k < n; ++k)
+        concentric_disk(u1[k], u2[k], x[k], y[k]);
+}
+
+template <typename T>
+void cosine_hemisphere_batch(const T* u1, const T* u2, T* x, T* y, T* z, size_t n) {
+    for (size_t k = 0; k < n; ++k)
+        cosine_hemisphere(u1[k], u2[k], x[k], y[k], z[k]);
+}
+
+template <typename T>
+void uniform_sphere_batch(const T* u1, const T* u2, T* x, T* y, T* z, size_t n) {
+    for (size_t k = 0; k < n; ++k)
+        uniform_sphere(u1[k], u2[k], x[k], y[k], z[k]);
+}
+
+// Tangents t and b of the unit vector n, such that (t, b, n) is an orthonormal basis. Without a branch for the
+// poles: Duff et al., Building an Orthonormal Basis, Revisited (JCGT 2017), https://jcgt.org/published/0006/01/01/
+template <typename T>
+inline void tangent_frame(const vec3_t<T>& n, vec3_t<T>& t, vec3_t<T>& b) {
+    T sign = std::copysign(T(1), n.z());
+    T a = -1 / (sign + n.z());
+    T c = n.x() * n.y() * a;
+    t = vec3_t<T>(1 + sign * n.x() * n.x() * a, sign * c, -sign * n.x());
+    b = vec3_t<T>(c, sign + n.y() * n.y() * a, -n.y());
+}
+
+// Direction (x, y, z) around +z turned to be around the unit vector n
+template <typename T>
+inline vec3_t<T> around_normal(const vec3_t<T>& n, T x, T y, T z) {
+    vec3_t<T> t, b;
+    tangent_frame(n, t, b);
+    return x*t + y*b + z*n;
+}
+
+// Random point inside a unit sphere
+template <typename T = real>
+vec3_t<T> random_in_unit_sphere() {
+    T u1 = random_double(), u2 = random_double(), u3 = random_double();
+    T x, y, z;
+    uniform_ball(u1, u2, u3, x, y, z);
+    return vec3_t<T>(x, y, z);
+}
+
+// Random unit vector
+template <typename T = real>
+vec3_t<T> random_unit_vector() {
+    T u1 = random_double(), u2 = random_double();
+    T x, y, z;
+    uniform_sphere(u1, u2, x, y, z);
+    return vec3_t<T>(x, y, z);
+}
+
+// Random cosine-weighted direction around the unit vector n, used in the Lambertian reflection
+template <typename T = real>
+vec3_t<T> random_cosine_direction(const vec3_t<T>& n) {
+    T u1 = random_double(), u2 = random_double();
+    T x, y, z;
+    cosine_hemisphere(u1, u2, x, y, z);
+    return around_normal(n, x, y, z);
+}
+
+// Random point inside unit disk
+template <typename T = real>
+vec3_t<T> random_in_unit_disk() {
+    T u1 = random_double(), u2 = random_double();
+    T x, y;
+    concentric_disk(u1, u2, x, y);
+    return vec3_t<T>(x, y, 0);
+}
+
+#endif
\ No newline at end of file
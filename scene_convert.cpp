@@ -0,0 +1,80 @@
+#include "rtweekend.h"
+
+#include "scenes.h"
+#include "scene_file.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/*
+Converts scene files (see scene_file.h).
+
+scene_convert INPUT OUTPUT
+
+INPUT is a scene file in either form, or random or metal for the scenes of final.cpp and metal.cpp (random takes
+--seed S, 0 by default, the seed final.cpp uses). OUTPUT gets the binary form if its name ends in .rtscene, the text
+form otherwise. For example
+
+scene_convert random random.scene
+scene_convert random.scene random.rtscene
+*/
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char* argv[]) {
+
+    uint64_t seed = 0;
+    const char* paths[2] = {nullptr, nullptr};
+    int path_count = 0;
+
+    for (int k = 1; k < argc; ++k) {
+        if (std::strcmp(argv[k], "--seed") == 0 && k + 1 < argc)
+            seed = std::strtoull(argv[++k], nullptr, 10);
+        else if (path_count < 2)
+            paths[path_count++] = argv[k];
+    }
+
+    if (path_count < 2) {
+        std::cerr << "Usage: scene_convert [--seed S] INPUT OUTPUT\n";
+        return 1;
+    }
+
+    std::string input = paths[0], output = paths[1];
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+
+        auto scene = [&] {
+            if (input == "random") {
+                seed_random(seed);
+                return loaded_scene{compiled_scene(random_scene()), random_scene_view(3.0 / 2.0)};
+            }
+            if (input == "metal")
+                return loaded_scene{compiled_scene(metal_scene()), metal_scene_view(16.0 / 9.0)};
+            return load_scene(input);
+        }();
+
+        std::chrono::duration<double, std::milli> loaded = std::chrono::steady_clock::now() - start;
+        std::cerr << "Read " << input << ": " << scene.world.sphere_count << " spheres, "
+                  << scene.world.material_count << " materials in " << loaded.count() << " ms\n";
+
+        if (ends_with(output, ".rtscene")) {
+            save_scene_binary(output, scene.world, scene.view);
+        } else {
+            std::ofstream out(output);
+            write_scene_text(out, scene.world, scene.view);
+            if (!out)
+                throw std::runtime_error("Cannot write " + output);
+        }
+
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,367 @@
+#include "scene_file.h"
+
+#include "material.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char scene_file_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+
+size_t align_up(size_t n) {
+    return (n + scene_file_alignment - 1) / scene_file_alignment * scene_file_alignment;
+}
+
+// True if the nodes form a tree traverse_linear_bvh can walk: children after their parent (so no cycle) and inside the
+// array, leaves inside the primitives, and no deeper than its stack
+bool valid_bvh(const linear_bvh_node* nodes, uint64_t node_count, uint64_t primitive_count) {
+    std::vector<int> depth(node_count, 0);
+    for (uint64_t k = 0; k < node_count; ++k) {
+        const auto& node = nodes[k];
+        if (depth[k] >= linear_bvh_stack_size)
+            return false;
+
+        if (node.count > 0) {
+            if (static_cast<uint64_t>(node.offset) + node.count > primitive_count)
+                return false;
+        } else {
+            if (node.axis > 2 || node.offset <= k + 1 || node.offset >= node_count)
+                return false;
+            depth[k+1] = std::max(depth[k+1], depth[k] + 1);
+            depth[node.offset] = std::max(depth[node.offset], depth[k] + 1);
+        }
+    }
+    return true;
+}
+
+std::runtime_error parse_error(int line, const std::string& message) {
+    return std::runtime_error("Scene file, line " + std::to_string(line) + ": " + message);
+}
+
+// Reads count numbers from the rest of the line
+void read_numbers(std::istringstream& in, int line, real* out, int count) {
+    for (int k = 0; k < count; ++k) {
+        double x;
+        if (!(in >> x))
+            throw parse_error(line, "expected a number");
+        out[k] = static_cast<real>(x);
+    }
+}
+
+// material has no virtual destructor, so the pointer must keep the deleter of the concrete type: make_shared does
+std::shared_ptr<material> make_material(const scene_file_material& m) {
+    // Checked as uint32 first: the cast to the uint8 enum would turn 256 into lambertian
+    if (m.kind > static_cast<uint32_t>(material_kind::dielectric))
+        throw std::runtime_error("Scene file: unknown material kind.");
+
+    color albedo(m.albedo[0], m.albedo[1], m.albedo[2]);
+    switch (static_cast<material_kind>(m.kind)) {
+        case material_kind::lambertian: return std::make_shared<lambertian>(albedo);
+        case material_kind::metal:      return std::make_shared<metal>(albedo, static_cast<real>(m.parameter));
+        case material_kind::dielectric: return std::make_shared<dielectric>(static_cast<real>(m.parameter));
+        default: throw std::runtime_error("Scene file: unknown material kind.");
+    }
+}
+
+scene_file_material describe_material(const material& m) {
+    scene_file_material out = {};
+    out.kind = static_cast<uint32_t>(m.kind);
+
+    auto set_albedo = [&](const color& a) {
+        for (int k = 0; k < 3; ++k) out.albedo[k] = a[k];
+    };
+
+    switch (m.kind) {
+        case material_kind::lambertian:
+            set_albedo(static_cast<const lambertian&>(m).albedo);
+            break;
+        case material_kind::metal:
+            set_albedo(static_cast<const metal&>(m).albedo);
+            out.parameter = static_cast<const metal&>(m).fuzz;
+            break;
+        case material_kind::dielectric:
+            out.parameter = static_cast<const dielectric&>(m).ir;
+            break;
+        default:
+            throw std::invalid_argument("Custom material in a scene file.");
+    }
+
+    return out;
+}
+
+void pack_camera(const camera_settings& cam, double* out) {
+    for (int k = 0; k < 3; ++k) {
+        out[k] = cam.lookfrom[k];
+        out[3+k] = cam.lookat[k];
+        out[6+k] = cam.vup[k];
+    }
+    out[9] = cam.vfov;
+    out[10] = cam.aspect_ratio;
+    out[11] = cam.aperture;
+    out[12] = cam.focus_dist;
+}
+
+camera_settings unpack_camera(const double* in) {
+    camera_settings cam;
+    cam.lookfrom = point3(in[0], in[1], in[2]);
+    cam.lookat = point3(in[3], in[4], in[5]);
+    cam.vup = vec3(in[6], in[7], in[8]);
+    cam.vfov = static_cast<real>(in[9]);
+    cam.aspect_ratio = static_cast<real>(in[10]);
+    cam.aperture = static_cast<real>(in[11]);
+    cam.focus_dist = static_cast<real>(in[12]);
+    return cam;
+}
+
+bool has_scene_magic(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(scene_file_magic)] = {};
+    in.read(magic, sizeof(magic));
+    return in && std::memcmp(magic, scene_file_magic, sizeof(magic)) == 0;
+}
+
+}
+
+loaded_scene read_scene_text(std::istream& in) {
+    hittable_list world;
+    camera_settings cam;
+    std::map<std::string, shared_ptr<material>> materials;
+
+    std::string text;
+    for (int line = 1; std::getline(in, text); ++line) {
+        auto comment = text.find('#');
+        if (comment != std::string::npos)
+            text.erase(comment);
+
+        std::istringstream fields(text);
+        std::string keyword;
+        if (!(fields >> keyword))
+            continue;
+
+        if (keyword == "camera") {
+            real v[13];
+            read_numbers(fields, line, v, 13);
+            cam.lookfrom = point3(v[0], v[1], v[2]);
+            cam.lookat = point3(v[3], v[4], v[5]);
+            cam.vup = vec3(v[6], v[7], v[8]);
+            cam.vfov = v[9];
+            cam.aspect_ratio = v[10];
+            cam.aperture = v[11];
+            cam.focus_dist = v[12];
+
+        } else if (keyword == "lambertian" || keyword == "metal" || keyword == "dielectric") {
+            std::string name;
+            if (!(fields >> name))
+                throw parse_error(line, "expected a material name");
+
+            real v[4];
+            if (keyword == "lambertian") {
+                read_numbers(fields, line, v, 3);
+                materials[name] = make_shared<lambertian>(color(v[0], v[1], v[2]));
+            } else if (keyword == "metal") {
+                read_numbers(fields, line, v, 4);
+                materials[name] = make_shared<metal>(color(v[0], v[1], v[2]), v[3]);
+            } else {
+                read_numbers(fields, line, v, 1);
+                materials[name] = make_shared<dielectric>(v[0]);
+            }
+
+        } else if (keyword == "sphere") {
+            real v[4];
+            read_numbers(fields, line, v, 4);
+
+            std::string name;
+            if (!(fields >> name))
+                throw parse_error(line, "expected a material name");
+            auto m = materials.find(name);
+            if (m == materials.end())
+                throw parse_error(line, "unknown material " + name);
+
+            world.add(make_shared<sphere>(point3(v[0], v[1], v[2]), v[3], m->second));
+
+        } else {
+            throw parse_error(line, "unknown statement " + keyword);
+        }
+
+        std::string extra;
+        if (fields >> extra)
+            throw parse_error(line, "unexpected " + extra);
+    }
+
+    if (world.objects.empty())
+        throw std::runtime_error("Scene file without spheres.");
+
+    return loaded_scene{compiled_scene(world), cam};
+}
+
+void write_scene_text(std::ostream& out, const compiled_scene& world, const camera_settings& cam) {
+    auto precision = out.precision(std::numeric_limits<real>::max_digits10);
+
+    double c[13];
+    pack_camera(cam, c);
+    out << "# " << world.sphere_count << " spheres, " << world.material_count << " materials\n\ncamera";
+    for (double x : c)
+        out << ' ' << static_cast<real>(x);
+    out << "\n\n";
+
+    for (size_t k = 0; k < world.material_count; ++k) {
+        auto m = describe_material(*world.materials[k]);
+        auto kind = world.materials[k]->kind;
+        switch (kind) {
+            case material_kind::lambertian: out << "lambertian"; break;
+            case material_kind::metal:      out << "metal"; break;
+            default:                        out << "dielectric"; break;
+        }
+        out << " m" << k;
+
+        if (kind != material_kind::dielectric)
+            out << ' ' << static_cast<real>(m.albedo[0]) << ' ' << static_cast<real>(m.albedo[1])
+                << ' ' << static_cast<real>(m.albedo[2]);
+        if (kind != material_kind::lambertian)
+            out << ' ' << static_cast<real>(m.parameter);
+        out << '\n';
+    }
+    out << '\n';
+
+    for (size_t k = 0; k < world.sphere_count; ++k) {
+        const auto& s = world.spheres[k];
+        out << "sphere " << s.center.x() << ' ' << s.center.y() << ' ' << s.center.z() << ' ' << s.radius
+            << " m" << s.material << '\n';
+    }
+
+    out.precision(precision);
+}
+
+void save_scene_binary(const std::string& path, const compiled_scene& world, const camera_settings& cam) {
+    scene_file_header header = {};
+    std::memcpy(header.magic, scene_file_magic, sizeof(header.magic));
+    header.version = scene_file_version;
+    header.byte_order = scene_file_byte_order;
+    header.real_size = sizeof(real);
+    header.vec3_size = sizeof(vec3);
+    header.node_size = sizeof(linear_bvh_node);
+    header.sphere_size = sizeof(packed_sphere);
+    header.node_count = world.node_count;
+    header.sphere_count = world.sphere_count;
+    header.material_count = world.material_count;
+    header.node_offset = align_up(sizeof(scene_file_header));
+    header.sphere_offset = align_up(header.node_offset + world.node_count * sizeof(linear_bvh_node));
+    header.material_offset = align_up(header.sphere_offset + world.sphere_count * sizeof(packed_sphere));
+    header.file_size = header.material_offset + world.material_count * sizeof(scene_file_material);
+    pack_camera(cam, header.camera);
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+
+    const char zeros[scene_file_alignment] = {};
+    auto pad_to = [&](uint64_t offset) {
+        out.write(zeros, static_cast<std::streamsize>(offset - static_cast<uint64_t>(out.tellp())));
+    };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad_to(header.node_offset);
+    out.write(reinterpret_cast<const char*>(world.nodes),
+              static_cast<std::streamsize>(world.node_count * sizeof(linear_bvh_node)));
+    pad_to(header.sphere_offset);
+    out.write(reinterpret_cast<const char*>(world.spheres),
+              static_cast<std::streamsize>(world.sphere_count * sizeof(packed_sphere)));
+    pad_to(header.material_offset);
+    for (size_t k = 0; k < world.material_count; ++k) {
+        auto m = describe_material(*world.materials[k]);
+        out.write(reinterpret_cast<const char*>(&m), sizeof(m));
+    }
+
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+}
+
+loaded_scene load_scene_binary(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(scene_file_header)) {
+        close(fd);
+        throw std::runtime_error(path + " is not a scene file.");
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        throw std::runtime_error("Cannot map " + path);
+
+    // Unmapped when the last scene pointing into it is gone
+    std::shared_ptr<const void> mapping(data, [size](const void* p) { munmap(const_cast<void*>(p), size); });
+
+    const auto* bytes = static_cast<const char*>(data);
+    const auto& header = *reinterpret_cast<const scene_file_header*>(bytes);
+
+    if (std::memcmp(header.magic, scene_file_magic, sizeof(header.magic)) != 0 || header.version != scene_file_version)
+        throw std::runtime_error(path + " is not a scene file of this version.");
+
+    if (header.byte_order != scene_file_byte_order || header.real_size != sizeof(real)
+        || header.vec3_size != sizeof(vec3) || header.node_size != sizeof(linear_bvh_node)
+        || header.sphere_size != sizeof(packed_sphere))
+        throw std::runtime_error(path + " was written by a build with another layout, convert it again.");
+
+    // Each offset is checked against the size before it is subtracted from it
+    bool fits = header.file_size == size
+        && header.node_offset <= size && header.sphere_offset <= size && header.material_offset <= size
+        && header.node_offset % scene_file_alignment == 0 && header.sphere_offset % scene_file_alignment == 0
+        && header.material_offset % scene_file_alignment == 0
+        && header.node_count > 0 && header.node_count <= (size - header.node_offset) / sizeof(linear_bvh_node)
+        && header.sphere_count <= (size - header.sphere_offset) / sizeof(packed_sphere)
+        && header.material_count <= (size - header.material_offset) / sizeof(scene_file_material);
+    if (!fits)
+        throw std::runtime_error(path + " is truncated or corrupted.");
+
+    auto nodes = reinterpret_cast<const linear_bvh_node*>(bytes + header.node_offset);
+    auto spheres = reinterpret_cast<const packed_sphere*>(bytes + header.sphere_offset);
+
+    // The traversal trusts the indices of the file, so they are checked once here
+    bool valid = valid_bvh(nodes, header.node_count, header.sphere_count);
+    for (uint64_t k = 0; k < header.sphere_count && valid; ++k)
+        valid = spheres[k].material < header.material_count;
+    if (!valid)
+        throw std::runtime_error(path + " is truncated or corrupted.");
+
+    // The materials are the only part that is built: they hold a virtual table
+    std::vector<std::shared_ptr<material>> owned;
+    std::vector<const material*> materials;
+    for (uint64_t k = 0; k < header.material_count; ++k) {
+        scene_file_material m;
+        std::memcpy(&m, bytes + header.material_offset + k * sizeof(m), sizeof(m));
+        owned.push_back(make_material(m));
+        materials.push_back(owned.back().get());
+    }
+
+    return loaded_scene{
+        compiled_scene(nodes, header.node_count, spheres, header.sphere_count, materials, mapping, size),
+        unpack_camera(header.camera)};
+}
+
+loaded_scene load_scene(const std::string& path) {
+    if (has_scene_magic(path))
+        return load_scene_binary(path);
+
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("Cannot open " + path);
+    return read_scene_text(in);
+}
@@ -0,0 +1,89 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "compiled_scene.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+/*Scene files.
+
+A scene is the spheres, their materials and the parameters of the camera, in one of two forms.
+
+The text form is meant to be written by hand. One statement per line, # starts a comment:
+
+    camera      lookfrom_x y z  lookat_x y z  vup_x y z  vfov  aspect_ratio  aperture  focus_dist
+    lambertian  name  r g b
+    metal       name  r g b  fuzz
+    dielectric  name  index_of_refraction
+    sphere      x y z  radius  material_name
+
+The camera takes the arguments of camera's constructor, in the same order. A material is defined before the spheres
+that use it. See metal.scene for an example.
+
+The binary form is the compiled scene itself (see compiled_scene.h): a header, then the BVH nodes and the spheres
+exactly as they are laid out in memory, then the materials. Loading maps the file and points the scene at it, so
+nothing is parsed or copied but the header and the few materials. The layout depends on the build (float or double,
+SIMD vec3 or not), which the header records; a file written by another build is rejected, convert it again from the
+text form. The offsets, the indices of the BVH and the material indices of the spheres are checked in one pass when
+loading, so that a truncated or corrupted file is rejected rather than read out of bounds; the coordinates are taken
+as they are.
+
+scene_convert.cpp converts between the two, and writes the scenes of scenes.h.*/
+
+// A compiled scene and its camera
+struct loaded_scene {
+    compiled_scene world;
+    camera_settings view;
+};
+
+// Header of the binary form
+struct scene_file_header {
+    char magic[8];              // "RTSCENE\0"
+    uint32_t version;
+    uint32_t byte_order;        // scene_file_byte_order as written by the machine that wrote the file
+    uint32_t real_size;         // Layout of the build that wrote the file
+    uint32_t vec3_size;
+    uint32_t node_size;
+    uint32_t sphere_size;
+    uint64_t node_count;
+    uint64_t sphere_count;
+    uint64_t material_count;
+    uint64_t node_offset;       // From the start of the file, multiples of scene_file_alignment
+    uint64_t sphere_offset;
+    uint64_t material_offset;
+    uint64_t file_size;
+    double camera[13];          // lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist
+};
+
+// A material of the binary form
+struct scene_file_material {
+    uint32_t kind;              // material_kind
+    uint32_t pad;
+    double albedo[3];           // Lambertian and metal
+    double parameter;           // Fuzz of a metal, index of refraction of a dielectric
+};
+
+const uint32_t scene_file_version = 1;
+const uint32_t scene_file_byte_order = 0x01020304;
+const size_t scene_file_alignment = 64;
+
+// Parses the text form. Throws std::runtime_error, with the line number, on a malformed line
+loaded_scene read_scene_text(std::istream& in);
+
+void write_scene_text(std::ostream& out, const compiled_scene& world, const camera_settings& cam);
+
+// Maps a file in the binary form
+loaded_scene load_scene_binary(const std::string& path);
+
+void save_scene_binary(const std::string& path, const compiled_scene& world, const camera_settings& cam);
+
+// Either form, told apart by the magic at the start of the binary form
+loaded_scene load_scene(const std::string& path);
+
+#endif
\ No newline at end of file
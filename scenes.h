@@ -0,0 +1,113 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+
+/*Scenes of the demos, shared with benchmark.cpp so it renders exactly what they render. The spheres are placed with
+random_double, so seed_random first to get the same scene every time.*/
+
+// Cover of the book: a ground, three big spheres and about 500 small ones, see final.cpp
+inline hittable_list random_scene() {
+    hittable_list world;
+
+    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, ground_material));
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<material> sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = color::random() * color::random();
+                    sphere_material = make_shared<lambertian>(albedo);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = make_shared<metal>(albedo, fuzz);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                } else {
+                    // glass
+                    sphere_material = make_shared<dielectric>(1.5);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = make_shared<dielectric>(1.5);
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+
+    return world;
+}
+
+inline camera_settings random_scene_view(real aspect_ratio) {
+    camera_settings view;
+    view.lookfrom = point3(13,2,3);
+    view.lookat = point3(0,0,0);
+    view.vup = vec3(0,1,0);
+    view.vfov = 20;
+    view.aspect_ratio = aspect_ratio;
+    view.focus_dist = 10.0;
+    view.aperture = 0.1;
+
+    return view;
+}
+
+inline camera random_scene_camera(real aspect_ratio) {
+    return random_scene_view(aspect_ratio).make_camera();
+}
+
+// Ground, three spheres and a hollow glass one, see metal.cpp
+inline hittable_list metal_scene() {
+    hittable_list spheres;
+
+    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0)); // Diffusive
+    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
+    auto material_left   = make_shared<dielectric>(1.5);                  // Refraction index is 1.5, same as glass
+    auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), .5);
+
+    spheres.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));  // Ground
+    spheres.add(make_shared<sphere>(point3( 0.0,    0.0, -1.0),   0.5, material_center));  // Middle Sphere
+    spheres.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.5, material_left));    // Left Sphere
+    spheres.add(make_shared<sphere>(point3( 1.0,    0.0, -1.0),   0.5, material_right));   // Right sphere
+    spheres.add(make_shared<sphere>(point3(-.4 ,    -.3,  0.0), -0.25, material_left));    // A hollow glass sphere. Negative radius leaves geometry unchanged but substitutes the outer material
+                                                                                           // by the inner one.
+    return spheres;
+}
+
+inline camera_settings metal_scene_view(real aspect_ratio) {
+    camera_settings view;
+    view.lookfrom = point3(3,3,2);
+    view.lookat = point3(0,0,-1);
+    view.vup = vec3(0,1,0);
+    view.vfov = 20;
+    view.aspect_ratio = aspect_ratio;
+    view.focus_dist = (view.lookfrom-view.lookat).length();
+    view.aperture = 2.0;
+
+    return view;
+}
+
+inline camera metal_scene_camera(real aspect_ratio) {
+    return metal_scene_view(aspect_ratio).make_camera();
+}
+
+#endif
\ No newline at end of file
@@ -8,21 +8,23 @@
 class sphere : public hittable {
     public:
         sphere() {}
-        sphere(point3 cen, double r, shared_ptr<material> m)
+        sphere(point3 cen, real r, shared_ptr<material> m)
             : center(cen), radius(r), mat_ptr(m) {};
 
         virtual bool hit(
-            const ray& r, double t_min, double t_max, hit_record& rec) const override; // Check https://stackoverflow.com/questions/18198314/what-is-the-override-keyword-in-c-used-for
+            const ray& r, real t_min, real t_max, hit_record& rec) const override; // Check https://stackoverflow.com/questions/18198314/what-is-the-override-keyword-in-c-used-for
+
+        virtual bool bounding_box(aabb& output_box) const override;
 
     public:
         point3 center;
-        double radius;
+        real radius;
         shared_ptr<material> mat_ptr;
 };
 
 // Accepts a range [t_min, t_max] for the range
 // The double colon :: is the scope resolution operator, and makes clear to which namespace something belongs. See: https://stackoverflow.com/questions/5345527/what-does-the-mean-in-c
-bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+inline bool sphere::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
 
     vec3 oc = r.origin() - center;
     auto a = r.direction().length_squared();
@@ -45,11 +47,20 @@ bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) cons
     rec.p = r.at(rec.t);                                // Remember that ray.at(t) is P(t)
     vec3 outward_normal = (rec.p - center) / radius;    // Normal vector constructed from the solution
     rec.set_face_normal(r, outward_normal);             // Decides whether it is outwards or innerwards
-    rec.mat_ptr = mat_ptr;
+    rec.mat_ptr = mat_ptr.get();
 
     //rec.normal = (rec.p - center) / radius; // Normal vector constructed from the solution
 
     return true;
 }
 
+inline bool sphere::bounding_box(aabb& output_box) const {
+
+    // The radius can be negative for hollow spheres (see metal.cpp), the box is the same
+    auto r = fabs(radius);
+    output_box = aabb(center - vec3(r, r, r), center + vec3(r, r, r));
+
+    return true;
+}
+
 #endif
\ No newline at end of file
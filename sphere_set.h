@@ -0,0 +1,328 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "sphere.h"
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SPHERE_SET_X86 1
+#endif
+
+/*Packed set of spheres intersected several at a time.
+
+A hittable_list of spheres pays a virtual call per sphere and reads centers and radii from objects spread over the
+heap. Here the spheres are stored as a structure of arrays (all the x coordinates together, then all the y, ...), so a
+single ray can be tested against 4 spheres at once with AVX2 or 8 with AVX-512, one sphere per lane. The kernel is
+picked once, at runtime, from the features of the CPU.
+
+Every kernel runs the same operations as sphere::hit, in the same order, in double and without fused multiply-adds,
+so they all find the same sphere at the same t (as does sphere::hit in the double build, unless the compiler is
+allowed to fuse its multiply-adds, e.g. with -march=native). Under RT_USE_FLOAT the ray is widened to double first,
+for the scalar test as for the vector lanes. The hit record is then filled by the scalar code.*/
+
+// Raw arrays of a sphere_set, as seen by the kernels
+struct sphere_set_view {
+    const double* center_x;
+    const double* center_y;
+    const double* center_z;
+    const double* radius;
+    size_t count;
+};
+
+// A kernel returns the index of the closest sphere hit in [t_min, t_max], or -1, and writes the root to t
+typedef long (*sphere_set_kernel)(const sphere_set_view& s, const ray& r, double t_min, double t_max, double& t);
+
+// No fused multiply-adds in the kernels: a function attribute with GCC, the fp pragma over the kernels with Clang
+#if defined(__GNUC__) && !defined(__clang__)
+#define SPHERE_SET_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define SPHERE_SET_NO_CONTRACT
+#endif
+
+#ifdef __clang__
+#pragma float_control(push)
+#pragma clang fp contract(off)
+#endif
+
+// Squared length of the direction of the ray, the a of the quadratic
+SPHERE_SET_NO_CONTRACT
+inline double sphere_set_a(const vec3& d) {
+    double dx = d.x(), dy = d.y(), dz = d.z();
+    return dx*dx + dy*dy + dz*dz;
+}
+
+// Same steps as sphere::hit. Spheres hit at the same t as the best so far replace it, like in hittable_list::hit
+SPHERE_SET_NO_CONTRACT
+inline void sphere_set_test(const sphere_set_view& s, size_t k, const ray& r, double t_min, double& t_max, long& best) {
+    const vec3& d = r.direction();
+    double dx = d.x(), dy = d.y(), dz = d.z();
+    double ocx = double(r.origin().x()) - s.center_x[k];
+    double ocy = double(r.origin().y()) - s.center_y[k];
+    double ocz = double(r.origin().z()) - s.center_z[k];
+
+    double a = sphere_set_a(d);
+    double half_b = ocx*dx + ocy*dy + ocz*dz;
+    double c = (ocx*ocx + ocy*ocy + ocz*ocz) - s.radius[k]*s.radius[k];
+
+    double discriminant = half_b*half_b - a*c;
+    if (discriminant < 0) return;
+    double sqrtd = std::sqrt(discriminant);
+
+    double root = (-half_b - sqrtd) / a;
+    if (root < t_min || t_max < root) {
+        root = (-half_b + sqrtd) / a;
+        if (root < t_min || t_max < root)
+            return;
+    }
+
+    t_max = root;
+    best = static_cast<long>(k);
+}
+
+SPHERE_SET_NO_CONTRACT
+inline long sphere_set_hit_scalar(const sphere_set_view& s, const ray& r, double t_min, double t_max, double& t) {
+    long best = -1;
+    for (size_t k = 0; k < s.count; ++k)
+        sphere_set_test(s, k, r, t_min, t_max, best);
+
+    t = t_max;
+    return best;
+}
+
+#ifdef SPHERE_SET_X86
+
+__attribute__((target("avx2"))) SPHERE_SET_NO_CONTRACT
+inline long sphere_set_hit_avx2(const sphere_set_view& s, const ray& r, double t_min, double t_max, double& t) {
+    auto o = r.origin();
+    auto d = r.direction();
+
+    const __m256d ox = _mm256_set1_pd(o.x()), oy = _mm256_set1_pd(o.y()), oz = _mm256_set1_pd(o.z());
+    const __m256d dx = _mm256_set1_pd(d.x()), dy = _mm256_set1_pd(d.y()), dz = _mm256_set1_pd(d.z());
+    const __m256d a = _mm256_set1_pd(sphere_set_a(d));
+    const __m256d lo = _mm256_set1_pd(t_min);
+    const __m256d zero = _mm256_setzero_pd();
+
+    long best = -1;
+    size_t k = 0;
+
+    for (; k + 4 <= s.count; k += 4) {
+        __m256d ocx = _mm256_sub_pd(ox, _mm256_loadu_pd(s.center_x + k));
+        __m256d ocy = _mm256_sub_pd(oy, _mm256_loadu_pd(s.center_y + k));
+        __m256d ocz = _mm256_sub_pd(oz, _mm256_loadu_pd(s.center_z + k));
+        __m256d rad = _mm256_loadu_pd(s.radius + k);
+
+        __m256d half_b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)), _mm256_mul_pd(ocz, dz));
+        __m256d c = _mm256_sub_pd(
+            _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz)),
+            _mm256_mul_pd(rad, rad));
+
+        __m256d disc = _mm256_sub_pd(_mm256_mul_pd(half_b, half_b), _mm256_mul_pd(a, c));
+        __m256d has_root = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+        if (_mm256_movemask_pd(has_root) == 0) continue;
+
+        __m256d sqrtd = _mm256_sqrt_pd(disc);
+        __m256d neg_b = _mm256_sub_pd(zero, half_b);
+        __m256d hi = _mm256_set1_pd(t_max);
+
+        __m256d root1 = _mm256_div_pd(_mm256_sub_pd(neg_b, sqrtd), a);
+        __m256d root2 = _mm256_div_pd(_mm256_add_pd(neg_b, sqrtd), a);
+        __m256d ok1 = _mm256_and_pd(_mm256_cmp_pd(root1, lo, _CMP_GE_OQ), _mm256_cmp_pd(root1, hi, _CMP_LE_OQ));
+        __m256d ok2 = _mm256_and_pd(_mm256_cmp_pd(root2, lo, _CMP_GE_OQ), _mm256_cmp_pd(root2, hi, _CMP_LE_OQ));
+
+        __m256d root = _mm256_blendv_pd(root2, root1, ok1);
+        int valid = _mm256_movemask_pd(_mm256_and_pd(has_root, _mm256_or_pd(ok1, ok2)));
+        if (valid == 0) continue;
+
+        // Lane order is sphere order, so ties resolve as in the scalar loop
+        double roots[4];
+        _mm256_storeu_pd(roots, root);
+        for (int lane = 0; lane < 4; ++lane) {
+            if ((valid >> lane & 1) && roots[lane] <= t_max) {
+                t_max = roots[lane];
+                best = static_cast<long>(k + lane);
+            }
+        }
+    }
+
+    for (; k < s.count; ++k)
+        sphere_set_test(s, k, r, t_min, t_max, best);
+
+    t = t_max;
+    return best;
+}
+
+__attribute__((target("avx512f"))) SPHERE_SET_NO_CONTRACT
+inline long sphere_set_hit_avx512(const sphere_set_view& s, const ray& r, double t_min, double t_max, double& t) {
+    auto o = r.origin();
+    auto d = r.direction();
+
+    const __m512d ox = _mm512_set1_pd(o.x()), oy = _mm512_set1_pd(o.y()), oz = _mm512_set1_pd(o.z());
+    const __m512d dx = _mm512_set1_pd(d.x()), dy = _mm512_set1_pd(d.y()), dz = _mm512_set1_pd(d.z());
+    const __m512d a = _mm512_set1_pd(sphere_set_a(d));
+    const __m512d lo = _mm512_set1_pd(t_min);
+    const __m512d zero = _mm512_setzero_pd();
+
+    long best = -1;
+    size_t k = 0;
+
+    for (; k + 8 <= s.count; k += 8) {
+        __m512d ocx = _mm512_sub_pd(ox, _mm512_loadu_pd(s.center_x + k));
+        __m512d ocy = _mm512_sub_pd(oy, _mm512_loadu_pd(s.center_y + k));
+        __m512d ocz = _mm512_sub_pd(oz, _mm512_loadu_pd(s.center_z + k));
+        __m512d rad = _mm512_loadu_pd(s.radius + k);
+
+        __m512d half_b = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, dx), _mm512_mul_pd(ocy, dy)), _mm512_mul_pd(ocz, dz));
+        __m512d c = _mm512_sub_pd(
+            _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, ocx), _mm512_mul_pd(ocy, ocy)), _mm512_mul_pd(ocz, ocz)),
+            _mm512_mul_pd(rad, rad));
+
+        __m512d disc = _mm512_sub_pd(_mm512_mul_pd(half_b, half_b), _mm512_mul_pd(a, c));
+        __mmask8 has_root = _mm512_cmp_pd_mask(disc, zero, _CMP_GE_OQ);
+        if (has_root == 0) continue;
+
+        __m512d sqrtd = _mm512_maskz_sqrt_pd(has_root, disc);
+        __m512d neg_b = _mm512_sub_pd(zero, half_b);
+        __m512d hi = _mm512_set1_pd(t_max);
+
+        __m512d root1 = _mm512_div_pd(_mm512_sub_pd(neg_b, sqrtd), a);
+        __m512d root2 = _mm512_div_pd(_mm512_add_pd(neg_b, sqrtd), a);
+        __mmask8 ok1 = _mm512_cmp_pd_mask(root1, lo, _CMP_GE_OQ) & _mm512_cmp_pd_mask(root1, hi, _CMP_LE_OQ);
+        __mmask8 ok2 = _mm512_cmp_pd_mask(root2, lo, _CMP_GE_OQ) & _mm512_cmp_pd_mask(root2, hi, _CMP_LE_OQ);
+
+        __m512d root = _mm512_mask_blend_pd(ok1, root2, root1);
+        unsigned valid = has_root & (ok1 | ok2);
+        if (valid == 0) continue;
+
+        double roots[8];
+        _mm512_storeu_pd(roots, root);
+        for (int lane = 0; lane < 8; ++lane) {
+            if ((valid >> lane & 1) && roots[lane] <= t_max) {
+                t_max = roots[lane];
+                best = static_cast<long>(k + lane);
+            }
+        }
+    }
+
+    for (; k < s.count; ++k)
+        sphere_set_test(s, k, r, t_min, t_max, best);
+
+    t = t_max;
+    return best;
+}
+
+#endif
+
+#ifdef __clang__
+#pragma float_control(pop)
+#endif
+
+// Widest kernel the CPU can run. Set the environment variable RT_SPHERE_KERNEL to "scalar", "avx2" or "avx512" to force one
+inline sphere_set_kernel select_sphere_set_kernel() {
+    const char* forced = std::getenv("RT_SPHERE_KERNEL");
+    std::string name = forced ? forced : "";
+
+    if (name == "scalar") return sphere_set_hit_scalar;
+
+#ifdef SPHERE_SET_X86
+    __builtin_cpu_init();
+    if ((name.empty() || name == "avx512") && __builtin_cpu_supports("avx512f")) return sphere_set_hit_avx512;
+    if ((name.empty() || name == "avx2" || name == "avx512") && __builtin_cpu_supports("avx2")) return sphere_set_hit_avx2;
+#endif
+
+    return sphere_set_hit_scalar;
+}
+
+class sphere_set : public hittable {
+    public:
+        sphere_set() {}
+
+        // Every object of the list must be a sphere
+        sphere_set(const hittable_list& list) {
+            for (const auto& object : list.objects) {
+                auto s = std::dynamic_pointer_cast<sphere>(object);
+                if (!s)
+                    throw std::invalid_argument("Object that is not a sphere in sphere_set constructor.");
+
+                add(s->center, s->radius, s->mat_ptr);
+            }
+        }
+
+        void add(point3 center, double r, shared_ptr<material> m) {
+            center_x.push_back(center.x());
+            center_y.push_back(center.y());
+            center_z.push_back(center.z());
+            radius.push_back(r);
+
+            // Spheres sharing a material share its id
+            auto found = material_ids.find(m.get());
+            if (found == material_ids.end()) {
+                found = material_ids.emplace(m.get(), static_cast<int>(materials.size())).first;
+                materials.push_back(m);
+            }
+            material_id.push_back(found->second);
+        }
+
+        size_t size() const { return radius.size(); }
+
+        virtual bool hit(
+            const ray& r, real t_min, real t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override;
+
+    public:
+        std::vector<double> center_x;
+        std::vector<double> center_y;
+        std::vector<double> center_z;
+        std::vector<double> radius;
+        std::vector<int> material_id;                   // Index in materials
+        std::vector<shared_ptr<material>> materials;    // Each material of the set once. Keeps them alive for the hit records
+
+    private:
+        std::unordered_map<const material*, int> material_ids;
+};
+
+inline bool sphere_set::hit(const ray& r, real t_min, real t_max, hit_record& rec) const {
+
+    static const sphere_set_kernel kernel = select_sphere_set_kernel();
+
+    sphere_set_view view = {center_x.data(), center_y.data(), center_z.data(), radius.data(), size()};
+    double root;
+    long k = kernel(view, r, t_min, t_max, root);
+    if (k < 0) return false;
+
+    // Same as the end of sphere::hit
+    point3 center(center_x[k], center_y[k], center_z[k]);
+    rec.t = root;
+    rec.p = r.at(rec.t);
+    vec3 outward_normal = (rec.p - center) / radius[k];
+    rec.set_face_normal(r, outward_normal);
+    rec.mat_ptr = materials[material_id[k]].get();
+
+    return true;
+}
+
+inline bool sphere_set::bounding_box(aabb& output_box) const {
+
+    if (size() == 0) return false;
+
+    for (size_t k = 0; k < size(); ++k) {
+        auto r = fabs(radius[k]);
+        aabb box(point3(center_x[k] - r, center_y[k] - r, center_z[k] - r),
+                 point3(center_x[k] + r, center_y[k] + r, center_z[k] + r));
+        output_box = k == 0 ? box : surrounding_box(output_box, box);
+    }
+
+    return true;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,147 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "rtweekend.h"
+
+#include "material.h"
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/*Render statistics.
+
+Built with -DRT_STATS (the RT_STATS option of CMakeLists.txt), the hot paths count what they do:
+
+    camera_rays         first segment of each path
+    secondary_rays      bounces, i.e. every other call to the scene's hit
+    node_visits         BVH nodes whose box was tested, one per packet in packet.h
+    primitive_tests     ray-sphere tests
+    scatters            calls to scatter, by material kind, and how many of them absorbed the ray
+    path_depth          histogram of the number of segments of each path, and how many were cut at max_depth
+
+Each thread counts in its own thread_stats, a plain thread_local with no atomics and no sharing. At the end of
+render_tiles every worker adds its counters to the render_stats of the settings, under a lock taken once per thread.
+The workers also time each tile. render() (renderer.h) adds the total time and samples, and write_json dumps it all.
+
+Without RT_STATS, RT_STAT(statement) expands to nothing, so the counting and the tile times are compiled out and
+render() only fills in the total time and samples.*/
+
+#ifdef RT_STATS
+#define RT_STAT(statement) statement
+#else
+#define RT_STAT(statement)
+#endif
+
+const int stats_depth_bins = 65;        // Path lengths 0 to 63, the last bin counts the longer ones
+
+// Counters of one thread
+struct thread_stats {
+    uint64_t camera_rays = 0;
+    uint64_t secondary_rays = 0;
+    uint64_t node_visits = 0;
+    uint64_t primitive_tests = 0;
+    uint64_t scatters[material_kind_count] = {};
+    uint64_t absorbed[material_kind_count] = {};
+    uint64_t path_depth[stats_depth_bins] = {};
+    uint64_t truncated_paths = 0;       // Paths stopped by max_depth
+
+    void add(const thread_stats& other) {
+        camera_rays += other.camera_rays;
+        secondary_rays += other.secondary_rays;
+        node_visits += other.node_visits;
+        primitive_tests += other.primitive_tests;
+        for (int k = 0; k < material_kind_count; ++k) {
+            scatters[k] += other.scatters[k];
+            absorbed[k] += other.absorbed[k];
+        }
+        for (int k = 0; k < stats_depth_bins; ++k)
+            path_depth[k] += other.path_depth[k];
+        truncated_paths += other.truncated_paths;
+    }
+};
+
+inline thread_stats& local_stats() {
+    thread_local thread_stats stats;
+    return stats;
+}
+
+// A path of depth segments ended
+inline void count_path(int depth, bool truncated = false) {
+    auto& stats = local_stats();
+    stats.path_depth[depth < stats_depth_bins - 1 ? depth : stats_depth_bins - 1]++;
+    stats.truncated_paths += truncated;
+}
+
+inline void count_scatter(material_kind kind, bool scattered) {
+    auto& stats = local_stats();
+    stats.scatters[static_cast<int>(kind)]++;
+    stats.absorbed[static_cast<int>(kind)] += !scattered;
+}
+
+struct tile_stats {
+    int x0, y0, x1, y1;
+    int thread;             // Worker that rendered it
+    double seconds;
+};
+
+// Statistics of a whole render
+struct render_stats {
+    thread_stats counters;
+    std::vector<tile_stats> tiles;
+    int threads = 0;
+    int max_depth = 0;
+    double seconds = 0;         // Wall time of the render
+    long samples = 0;           // Camera samples taken, see framebuffer::total_samples
+
+    // Without RT_STATS, only the time and the samples
+    void write_json(std::ostream& out) const {
+        auto per_second = [&](double n) { return seconds > 0 ? n / seconds : 0; };
+
+        out << "{\n"
+            << "  \"threads\": " << threads << ",\n"
+            << "  \"seconds\": " << seconds << ",\n"
+            << "  \"samples\": " << samples << ",\n"
+            << "  \"samples_per_second\": " << per_second(samples);
+
+#ifdef RT_STATS
+        static const char* kind_names[material_kind_count] = {"lambertian", "metal", "dielectric", "custom"};
+
+        out << ",\n"
+            << "  \"camera_rays\": " << counters.camera_rays << ",\n"
+            << "  \"secondary_rays\": " << counters.secondary_rays << ",\n"
+            << "  \"rays_per_second\": " << per_second(counters.camera_rays + counters.secondary_rays) << ",\n"
+            << "  \"node_visits\": " << counters.node_visits << ",\n"
+            << "  \"primitive_tests\": " << counters.primitive_tests << ",\n";
+
+        out << "  \"scatters\": {";
+        for (int k = 0; k < material_kind_count; ++k)
+            out << (k ? ", " : "") << '"' << kind_names[k] << "\": {\"calls\": " << counters.scatters[k]
+                << ", \"absorbed\": " << counters.absorbed[k] << '}';
+        out << "},\n";
+
+        // The histogram up to max_depth, or the last non-empty bin
+        int bins = stats_depth_bins;
+        while (bins > max_depth + 1 && counters.path_depth[bins-1] == 0)
+            bins--;
+        out << "  \"max_depth\": " << max_depth << ",\n"
+            << "  \"truncated_paths\": " << counters.truncated_paths << ",\n"
+            << "  \"path_depth\": [";
+        for (int k = 0; k < bins; ++k)
+            out << (k ? ", " : "") << counters.path_depth[k];
+        out << "],\n";
+
+        out << "  \"tiles\": [";
+        for (size_t k = 0; k < tiles.size(); ++k) {
+            const auto& t = tiles[k];
+            out << (k ? ",\n" : "\n") << "    {\"x0\": " << t.x0 << ", \"y0\": " << t.y0 << ", \"x1\": " << t.x1
+                << ", \"y1\": " << t.y1 << ", \"thread\": " << t.thread << ", \"seconds\": " << t.seconds << '}';
+        }
+        out << (tiles.empty() ? "]" : "\n  ]");
+#endif
+
+        out << "\n}\n";
+    }
+};
+
+#endif
\ No newline at end of file
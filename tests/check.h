@@ -0,0 +1,56 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+/*Checks of the tests.
+
+Each test is a program of its own, run by ctest (see CMakeLists.txt). A failed check prints its file, line and
+expression and the test goes on, so one run lists every failure; main returns check_result(), non-zero if any check
+failed.*/
+
+inline int& failed_checks() {
+    static int count = 0;
+    return count;
+}
+
+inline void check_failed(const char* file, int line, const char* what) {
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    ++failed_checks();
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) check_failed(__FILE__, __LINE__, #condition); \
+    } while (0)
+
+// The statement must throw an exception_type
+#define CHECK_THROWS(exception_type, statement) \
+    do { \
+        bool thrown = false; \
+        try { statement; } catch (const exception_type&) { thrown = true; } catch (...) {} \
+        if (!thrown) check_failed(__FILE__, __LINE__, #statement " throws " #exception_type); \
+    } while (0)
+
+inline int check_result() {
+    if (failed_checks() > 0)
+        std::fprintf(stderr, "%d check(s) failed\n", failed_checks());
+    return failed_checks() > 0 ? 1 : 0;
+}
+
+// Whole content of a file, and a file of the given content
+
+inline std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+inline void write_file(const std::string& path, const std::string& data) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include "rtweekend.h"
+
+#include "check.h"
+#include "framebuffer.h"
+#include "progressive.h"
+#include "sampler.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Checkpoints of progressive.h: save and load, checkpoints of another render, truncated or corrupted ones, and
+// renders stopped and resumed through them
+
+namespace {
+
+const std::string checkpoint_path = "checkpoint_test.ckpt";
+
+render_settings test_settings() {
+    render_settings settings;
+    settings.image_width = 13;
+    settings.image_height = 7;
+    settings.samples_per_pixel = 12;
+    settings.max_depth = 5;
+    settings.threads = 2;
+    settings.tile_size = 4;
+    settings.seed = 1234;
+    return settings;
+}
+
+// Any image, different from pixel to pixel
+framebuffer test_image(const render_settings& settings) {
+    framebuffer image(settings.image_width, settings.image_height);
+    for (int j = 0; j < image.height; ++j)
+        for (int i = 0; i < image.width; ++i)
+            image.store(i, j, color(i + 0.25, j * 0.5, 1.0 / (i + j + 1)), (i + j) % 5);
+    return image;
+}
+
+bool same_image(const framebuffer& a, const framebuffer& b) {
+    if (a.samples != b.samples)
+        return false;
+    for (size_t p = 0; p < a.pixels.size(); ++p)
+        for (int k = 0; k < 3; ++k)
+            if (a.pixels[p][k] != b.pixels[p][k])
+                return false;
+    return true;
+}
+
+// Whether load_checkpoint refuses a file of this content, leaving the image as it was
+bool rejected(const std::string& data, const render_settings& settings, sampler_kind sampler) {
+    write_file(checkpoint_path, data);
+    framebuffer image(settings.image_width, settings.image_height);
+    image.store(0, 0, color(1, 2, 3), 4);
+    auto before = image;
+
+    try {
+        load_checkpoint(checkpoint_path, settings, sampler, image);
+    } catch (const std::runtime_error&) {
+        return same_image(image, before);
+    }
+    return false;
+}
+
+void check_round_trip() {
+    auto settings = test_settings();
+    auto image = test_image(settings);
+
+    std::remove(checkpoint_path.c_str());
+    framebuffer loaded(settings.image_width, settings.image_height);
+    CHECK(!load_checkpoint(checkpoint_path, settings, sampler_kind::sobol, loaded));
+
+    save_checkpoint(checkpoint_path, settings, sampler_kind::sobol, image);
+    CHECK(load_checkpoint(checkpoint_path, settings, sampler_kind::sobol, loaded));
+    CHECK(same_image(image, loaded));
+
+    // Only the checkpoint is left, not its temporary
+    CHECK(!std::ifstream(checkpoint_path + ".tmp"));
+
+    // A framebuffer of another size than the settings
+    framebuffer small(settings.image_width - 1, settings.image_height);
+    CHECK_THROWS(std::invalid_argument, load_checkpoint(checkpoint_path, settings, sampler_kind::sobol, small));
+}
+
+void check_other_renders() {
+    auto settings = test_settings();
+    save_checkpoint(checkpoint_path, settings, sampler_kind::sobol, test_image(settings));
+    auto file = read_file(checkpoint_path);
+
+    CHECK(rejected(file, settings, sampler_kind::halton));
+    CHECK(rejected(file, settings, sampler_kind::random));
+
+    auto other = settings;
+    other.seed++;
+    CHECK(rejected(file, other, sampler_kind::sobol));
+
+    other = settings;
+    other.max_depth++;
+    CHECK(rejected(file, other, sampler_kind::sobol));
+
+    other = settings;
+    other.image_width++;
+    CHECK(rejected(file, other, sampler_kind::sobol));
+
+    // samples_per_pixel is not part of the render: a checkpoint can be carried on to more samples
+    other = settings;
+    other.samples_per_pixel *= 2;
+    CHECK(!rejected(file, other, sampler_kind::sobol));
+}
+
+void check_truncated_and_corrupted() {
+    auto settings = test_settings();
+    save_checkpoint(checkpoint_path, settings, sampler_kind::random, test_image(settings));
+    auto file = read_file(checkpoint_path);
+
+    for (size_t size = 0; size < file.size(); ++size)
+        CHECK(rejected(file.substr(0, size), settings, sampler_kind::random));
+
+    CHECK(rejected(file + '\0', settings, sampler_kind::random));
+
+    // Magic, version and real type
+    for (size_t offset : {offsetof(checkpoint_header, magic), offsetof(checkpoint_header, version),
+                          offsetof(checkpoint_header, real_size)}) {
+        auto data = file;
+        data[offset] ^= 1;
+        CHECK(rejected(data, settings, sampler_kind::random));
+    }
+
+    // A negative sample count, the last of the file
+    auto data = file;
+    int32_t negative = -1;
+    std::memcpy(&data[data.size() - sizeof(negative)], &negative, sizeof(negative));
+    CHECK(rejected(data, settings, sampler_kind::random));
+}
+
+// A sample whose color depends on the random numbers it draws, so a sample drawn from another stream is seen
+color test_sample(int i, int j, int s) {
+    return color(random_double(), random_double() + i, random_double() + j + s);
+}
+
+void check_stopped_and_resumed() {
+    auto settings = test_settings();
+    progressive_settings progressive;
+    progressive.pass_samples = 5;
+
+    render_control quiet;
+    settings.control = &quiet;
+
+    // In one go
+    framebuffer whole(settings.image_width, settings.image_height);
+    CHECK(render_progressive(settings, progressive, sampler_kind::random, whole, test_sample));
+    CHECK(whole.total_samples() == long(settings.samples_per_pixel) * settings.image_width * settings.image_height);
+
+    // Stopped in the middle of the second pass, then resumed from the checkpoint it wrote
+    std::remove(checkpoint_path.c_str());
+    progressive.checkpoint = checkpoint_path;
+
+    std::atomic<bool> stop(false);
+    int passes = 0;
+    progressive.pass_done = [&](const framebuffer&, int) { passes++; };
+    render_control stopping;
+    stopping.cancel = &stop;
+    stopping.progress = [&](int done, int total) {
+        if (passes == 1 && done >= total / 2)
+            stop = true;
+    };
+    settings.control = &stopping;
+
+    framebuffer first(settings.image_width, settings.image_height);
+    CHECK(!render_progressive(settings, progressive, sampler_kind::random, first, test_sample));
+    CHECK(passes == 1);
+
+    settings.control = &quiet;
+    framebuffer resumed(settings.image_width, settings.image_height);
+    CHECK(load_checkpoint(checkpoint_path, settings, sampler_kind::random, resumed));
+    CHECK(same_image(resumed, first));
+    CHECK(render_progressive(settings, progressive, sampler_kind::random, resumed, test_sample));
+    CHECK(same_image(resumed, whole));
+
+    // Carried on to more samples from the finished render
+    progressive.checkpoint.clear();
+    auto more = settings;
+    more.samples_per_pixel = 20;
+    framebuffer longer(settings.image_width, settings.image_height);
+    CHECK(render_progressive(more, progressive, sampler_kind::random, longer, test_sample));
+    CHECK(render_progressive(more, progressive, sampler_kind::random, whole, test_sample));
+    CHECK(same_image(whole, longer));
+
+    // An empty image has nothing to render
+    auto empty = settings;
+    empty.image_width = 0;
+    framebuffer nothing(0, settings.image_height);
+    CHECK(render_progressive(empty, progressive, sampler_kind::random, nothing, test_sample));
+}
+
+}
+
+int main() {
+    check_round_trip();
+    check_other_renders();
+    check_truncated_and_corrupted();
+    check_stopped_and_resumed();
+
+    std::remove(checkpoint_path.c_str());
+    return check_result();
+}
\ No newline at end of file
@@ -0,0 +1,460 @@
+#include "rtweekend.h"
+
+#include "check.h"
+#include "distributed.h"
+#include "renderer.h"
+#include "scenes.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// The wire protocol of distributed.cpp, spoken by hand: a coordinator must drop a worker that sends garbage and finish
+// the frame with the others, and a worker must hang up on a coordinator that sends garbage. Both sides stay in this
+// process, on a Unix socket
+
+namespace {
+
+// The messages of distributed.cpp, as they travel
+enum class message_type : uint32_t { hello = 1, frame, tile, result, quit };
+
+struct message_header {
+    uint32_t type;
+    uint32_t size;
+};
+
+struct hello_message {
+    uint32_t version;
+    uint32_t real_size;
+    int32_t threads;
+};
+
+struct frame_message {
+    uint32_t frame;
+    int32_t image_width;
+    int32_t image_height;
+    int32_t samples_per_pixel;
+    int32_t max_depth;
+    int32_t tile_size;
+    int32_t integrator;
+    int32_t packet_size;
+    int32_t sampler;
+    int32_t pad;
+    uint64_t seed;
+    double camera[13];
+};
+
+struct tile_message {
+    uint32_t frame;
+    uint32_t id;
+    int32_t x0, y0, x1, y1;
+};
+
+const uint32_t protocol_version = 2;
+const std::string socket_path = "distributed_test.sock";
+const std::string address = "unix:" + socket_path;
+const std::string scene_name = "random:7";
+
+// Both ends give up on a silent peer after a few seconds rather than hang the test
+void set_timeout(int fd) {
+    timeval limit = {10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+}
+
+sockaddr_un socket_address() {
+    sockaddr_un un = {};
+    un.sun_family = AF_UNIX;
+    std::memcpy(un.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return un;
+}
+
+bool read_bytes(int fd, void* data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+    while (size > 0) {
+        auto n = recv(fd, bytes, size, 0);
+        if (n <= 0)
+            return false;
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool send_bytes(int fd, const std::string& data) {
+    return send(fd, data.data(), data.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(data.size());
+}
+
+template <typename T>
+std::string bytes_of(const T& value) {
+    return std::string(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+std::string message(message_type type, const std::string& payload) {
+    return bytes_of(message_header{static_cast<uint32_t>(type), static_cast<uint32_t>(payload.size())}) + payload;
+}
+
+// Next message from fd, false once the peer has hung up
+bool receive(int fd, message_header& header, std::string& payload) {
+    if (!read_bytes(fd, &header, sizeof(header)))
+        return false;
+    payload.assign(header.size, '\0');
+    return read_bytes(fd, &payload[0], payload.size());
+}
+
+// Whether the peer hung up, reading past anything it still had to say. A peer that closes before reading all we sent
+// resets the connection instead, which is also hanging up
+bool hung_up(int fd) {
+    char buffer[4096];
+    while (true) {
+        auto n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n == 0 || (n < 0 && errno == ECONNRESET))
+            return true;
+        if (n < 0)
+            return false;
+    }
+}
+
+render_settings test_settings() {
+    render_settings settings;
+    settings.image_width = 24;
+    settings.image_height = 16;
+    settings.samples_per_pixel = 2;
+    settings.max_depth = 8;
+    settings.seed = 11;
+    return settings;
+}
+
+framebuffer local_render(const render_settings& settings, const render_options& options) {
+    auto scene = load_named_scene(scene_name);
+    render_control quiet;
+    auto local = settings;
+    local.control = &quiet;
+
+    framebuffer image(settings.image_width, settings.image_height);
+    render(scene.world, scene.view.make_camera(), local, image, options);
+    return image;
+}
+
+bool same_image(const framebuffer& a, const framebuffer& b) {
+    if (a.samples != b.samples)
+        return false;
+    for (size_t p = 0; p < a.pixels.size(); ++p)
+        for (int k = 0; k < 3; ++k)
+            if (a.pixels[p][k] != b.pixels[p][k])
+                return false;
+    return true;
+}
+
+// What a hostile worker answers to the first tile it gets, given that tile
+typedef std::function<std::string(const tile_message& t)> worker_answer;
+
+std::string result_of(const tile_message& t, size_t pixels) {
+    std::string sums_and_counts(pixels * (3 * sizeof(real) + sizeof(int32_t)), '\0');
+    return message(message_type::result, bytes_of(t) + sums_and_counts);
+}
+
+size_t pixels_of(const tile_message& t) {
+    return static_cast<size_t>(t.x1 - t.x0) * static_cast<size_t>(t.y1 - t.y0);
+}
+
+// Renders a frame with a worker that says hello (or what hello is given), answers its first tile with answer, and
+// must then be dropped; a well-behaved worker, started once that happened, finishes the frame
+void check_hostile_worker(const std::string& name, worker_answer answer, std::string hello = "") {
+    auto settings = test_settings();
+    render_options options;
+
+    distributed_settings config;
+    config.address = address;
+    config.tile_size = 8;
+    config.worker_timeout = 20;
+
+    framebuffer image(settings.image_width, settings.image_height);
+    bool dropped = false;
+    std::thread honest;
+
+    {
+        coordinator tiles(config);
+
+        std::thread hostile([&] {
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            auto target = socket_address();
+            if (connect(fd, reinterpret_cast<const sockaddr*>(&target), sizeof(target)) == 0) {
+                set_timeout(fd);
+                if (hello.empty())
+                    hello = message(message_type::hello, bytes_of(hello_message{protocol_version, sizeof(real), 1}));
+                send_bytes(fd, hello);
+
+                // The frame comes first
+                const auto tile_type = static_cast<uint32_t>(message_type::tile);
+                message_header header = {};
+                std::string payload;
+                while (receive(fd, header, payload) && header.type != tile_type) {}
+
+                if (header.type == tile_type && payload.size() == sizeof(tile_message)) {
+                    tile_message t;
+                    std::memcpy(&t, payload.data(), sizeof(t));
+                    send_bytes(fd, answer(t));
+                }
+                dropped = hung_up(fd);
+            }
+            close(fd);
+
+            honest = std::thread([] {
+                try {
+                    run_worker(address, 1);
+                } catch (const std::exception& e) {
+                    std::fprintf(stderr, "%s\n", e.what());
+                }
+            });
+        });
+
+        render_control quiet;
+        settings.control = &quiet;
+        try {
+            CHECK(tiles.render(distributed_frame{scene_name, random_scene_view(3.0 / 2.0), settings, options}, image)
+                  == render_result::completed);
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "%s: %s\n", name.c_str(), e.what());
+            check_failed(__FILE__, __LINE__, "render with a hostile worker");
+        }
+
+        hostile.join();
+    }
+
+    // The coordinator is gone, which tells the honest worker to quit
+    if (honest.joinable())
+        honest.join();
+
+    if (!dropped)
+        std::fprintf(stderr, "%s: the worker was not dropped\n", name.c_str());
+    CHECK(dropped);
+    CHECK(same_image(image, local_render(test_settings(), options)));
+}
+
+// A peer that connects and never says hello is dropped, and doesn't keep the render from timing out
+void check_silent_peer() {
+    auto settings = test_settings();
+    render_control quiet;
+    settings.control = &quiet;
+
+    distributed_settings config;
+    config.address = address;
+    config.worker_timeout = 2;
+    config.hello_timeout = 0.5;
+
+    coordinator tiles(config);
+    bool dropped = false;
+    std::thread silent([&] {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        auto target = socket_address();
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&target), sizeof(target)) == 0) {
+            set_timeout(fd);
+            dropped = hung_up(fd);
+        }
+        close(fd);
+    });
+
+    framebuffer image(settings.image_width, settings.image_height);
+    CHECK_THROWS(std::runtime_error,
+                 tiles.render(distributed_frame{scene_name, random_scene_view(3.0 / 2.0), settings, {}}, image));
+    silent.join();
+    CHECK(dropped);
+}
+
+void check_hostile_workers() {
+    check_hostile_worker("shifted rectangle", [](tile_message t) {
+        t.x0++;
+        t.x1++;
+        return result_of(t, pixels_of(t));
+    });
+
+    check_hostile_worker("larger rectangle", [](tile_message t) {
+        t.x0 = -100;
+        t.y1 = 1000;
+        return result_of(t, pixels_of(t));
+    });
+
+    check_hostile_worker("tile out of range", [](tile_message t) {
+        t.id = 1000;
+        return result_of(t, pixels_of(t));
+    });
+
+    check_hostile_worker("short result", [](tile_message t) { return result_of(t, pixels_of(t) - 1); });
+
+    check_hostile_worker("result without its tile", [](tile_message) {
+        return message(message_type::result, std::string(sizeof(tile_message) - 1, '\0'));
+    });
+
+    check_hostile_worker("unknown message", [](tile_message t) { return message(message_type::quit, bytes_of(t)); });
+
+    check_hostile_worker("oversized message", [](tile_message) {
+        return bytes_of(message_header{static_cast<uint32_t>(message_type::result), 0xffffffffu});
+    });
+
+    // Turned away at hello: it never gets a tile
+    auto no_answer = [](tile_message) { return std::string(); };
+    check_hostile_worker("other version", no_answer,
+                         message(message_type::hello, bytes_of(hello_message{protocol_version + 1, sizeof(real), 1})));
+    check_hostile_worker("other real type", no_answer,
+                         message(message_type::hello, bytes_of(hello_message{protocol_version, 3, 1})));
+    check_hostile_worker("short hello", no_answer, message(message_type::hello, "hi"));
+}
+
+frame_message test_frame() {
+    auto settings = test_settings();
+    frame_message frame = {};
+    frame.frame = 1;
+    frame.image_width = settings.image_width;
+    frame.image_height = settings.image_height;
+    frame.samples_per_pixel = settings.samples_per_pixel;
+    frame.max_depth = settings.max_depth;
+    frame.tile_size = settings.tile_size;
+    frame.integrator = static_cast<int32_t>(integrator_kind::path);
+    frame.packet_size = 8;
+    frame.sampler = static_cast<int32_t>(sampler_kind::random);
+    frame.seed = settings.seed;
+
+    auto v = random_scene_view(3.0 / 2.0);
+    double camera[13] = {v.lookfrom.x(), v.lookfrom.y(), v.lookfrom.z(), v.lookat.x(), v.lookat.y(), v.lookat.z(),
+                         v.vup.x(), v.vup.y(), v.vup.z(), v.vfov, v.aspect_ratio, v.aperture, v.focus_dist};
+    std::memcpy(frame.camera, camera, sizeof(camera));
+    return frame;
+}
+
+std::string frame_of(const frame_message& frame, const std::string& name = scene_name) {
+    return message(message_type::frame, bytes_of(frame) + name);
+}
+
+std::string tile_of(int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+    return message(message_type::tile, bytes_of(tile_message{1, 0, x0, y0, x1, y1}));
+}
+
+// Runs a worker against a coordinator that sends it messages. True if the worker answered each tile with a result
+// of its size (results is how many) and then hung up or quit when told to
+bool run_hostile_coordinator(const std::string& messages, int results) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    auto own = socket_address();
+    unlink(socket_path.c_str());
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&own), sizeof(own)) != 0 || listen(listener, 1) != 0) {
+        close(listener);
+        return false;
+    }
+
+    bool worker_threw = false;
+    std::thread worker([&] {
+        try {
+            run_worker(address, 1);
+        } catch (const std::exception&) {
+            worker_threw = true;
+        }
+    });
+
+    bool ok = false;
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd >= 0) {
+        set_timeout(fd);
+        message_header header;
+        std::string payload;
+        ok = receive(fd, header, payload) && header.type == static_cast<uint32_t>(message_type::hello);
+
+        send_bytes(fd, messages);
+        for (int k = 0; k < results && ok; ++k) {
+            ok = receive(fd, header, payload) && header.type == static_cast<uint32_t>(message_type::result)
+                && payload.size() >= sizeof(tile_message);
+            if (ok) {
+                tile_message t;
+                std::memcpy(&t, payload.data(), sizeof(t));
+                ok = payload.size() == sizeof(t) + pixels_of(t) * (3 * sizeof(real) + sizeof(int32_t));
+            }
+        }
+
+        ok = ok && hung_up(fd);
+        close(fd);
+    }
+
+    worker.join();
+    close(listener);
+    unlink(socket_path.c_str());
+    return ok && !worker_threw;
+}
+
+void check_hostile_coordinators() {
+    auto frame = test_frame();
+    auto quit = message(message_type::quit, "");
+
+    // A well-behaved coordinator first
+    CHECK(run_hostile_coordinator(frame_of(frame) + tile_of(0, 0, 8, 8) + quit, 1));
+
+    auto bad = frame;
+    bad.integrator = 99;
+    CHECK(run_hostile_coordinator(frame_of(bad) + tile_of(0, 0, 8, 8), 0));
+    bad.integrator = -1;
+    CHECK(run_hostile_coordinator(frame_of(bad) + tile_of(0, 0, 8, 8), 0));
+    bad.integrator = static_cast<int32_t>(integrator_kind::adaptive);
+    CHECK(run_hostile_coordinator(frame_of(bad) + tile_of(0, 0, 8, 8), 0));
+
+    bad = frame;
+    bad.sampler = 99;
+    CHECK(run_hostile_coordinator(frame_of(bad) + tile_of(0, 0, 8, 8), 0));
+    bad.sampler = static_cast<int32_t>(sampler_kind::sobol);
+    bad.integrator = static_cast<int32_t>(integrator_kind::packets);
+    CHECK(run_hostile_coordinator(frame_of(bad) + tile_of(0, 0, 8, 8), 0));
+
+    // Packets the renderer has no room for
+    bad = frame;
+    bad.integrator = static_cast<int32_t>(integrator_kind::packets);
+    CHECK(run_hostile_coordinator(frame_of(bad) + tile_of(0, 0, 8, 8) + quit, 1));
+    for (int32_t size : {0, -2, 9, 1 << 16}) {
+        bad.packet_size = size;
+        CHECK(run_hostile_coordinator(frame_of(bad) + tile_of(0, 0, 8, 8), 0));
+    }
+
+    // Sizes, counts and tile sizes that are zero or negative
+    for (int32_t frame_message::*field : {&frame_message::image_width, &frame_message::image_height,
+                                          &frame_message::samples_per_pixel, &frame_message::max_depth,
+                                          &frame_message::tile_size}) {
+        for (int32_t value : {0, -4}) {
+            bad = frame;
+            bad.*field = value;
+            CHECK(run_hostile_coordinator(frame_of(bad) + tile_of(0, 0, 8, 8), 0));
+        }
+    }
+
+    // A scene the worker can't load
+    CHECK(run_hostile_coordinator(frame_of(frame, "no_such_scene.rtscene") + tile_of(0, 0, 8, 8), 0));
+
+    // Tiles outside the image, empty, or before any frame
+    CHECK(run_hostile_coordinator(frame_of(frame) + tile_of(-8, 0, 8, 8), 0));
+    CHECK(run_hostile_coordinator(frame_of(frame) + tile_of(16, 8, 32, 24), 0));
+    CHECK(run_hostile_coordinator(frame_of(frame) + tile_of(8, 8, 8, 16), 0));
+    CHECK(run_hostile_coordinator(frame_of(frame) + tile_of(8, 8, 4, 16), 0));
+    CHECK(run_hostile_coordinator(tile_of(0, 0, 8, 8), 0));
+
+    // Messages that are cut, unknown or too large
+    CHECK(run_hostile_coordinator(message(message_type::tile, "short"), 0));
+    CHECK(run_hostile_coordinator(message(static_cast<message_type>(42), ""), 0));
+    auto oversized = message_header{static_cast<uint32_t>(message_type::frame), 0xffffffffu};
+    CHECK(run_hostile_coordinator(bytes_of(oversized), 0));
+}
+
+}
+
+int main() {
+    check_hostile_workers();
+    check_silent_peer();
+    check_hostile_coordinators();
+
+    unlink(socket_path.c_str());
+    return check_result();
+}
\ No newline at end of file
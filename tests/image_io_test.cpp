@@ -0,0 +1,264 @@
+#include "rtweekend.h"
+
+#include "check.h"
+#include "color.h"
+#include "framebuffer.h"
+#include "image_io.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef RT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// The encoders of image_io.h, read back by the decoders below, written from the specifications rather than from the
+// encoders: PNG chunks and their CRC-32, the zlib stream and its Adler-32, PFM and PPM
+
+namespace {
+
+// An image with dark, bright (clamped) and ordinary pixels, and some without samples unless all have some
+framebuffer test_image(int width, int height, bool all_sampled = false) {
+    framebuffer image(width, height);
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            int n = (i + j) % 4 == 3 && !all_sampled ? 0 : i + 1;
+            image.store(i, j, color(i * 0.05, j * 0.1, (i * j) % 3 == 0 ? 4.0 : 0.3) * n, n);
+        }
+    }
+    return image;
+}
+
+uint32_t be32(const std::string& data, size_t at) {
+    auto b = reinterpret_cast<const uint8_t*>(data.data() + at);
+    return uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8 | b[3];
+}
+
+// CRC-32 of PNG, bit by bit
+uint32_t crc32_bitwise(const std::string& data) {
+    uint32_t crc = 0xffffffffu;
+    for (unsigned char c : data) {
+        crc ^= c;
+        for (int k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+uint32_t adler32(const std::string& data) {
+    uint32_t a = 1, b = 0;
+    for (unsigned char c : data) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
+
+// Data of a zlib stream, checked against its Adler-32. False if the stream is broken
+bool inflate_zlib(const std::string& stream, std::string& out) {
+    if (stream.size() < 6 || (uint8_t(stream[0]) & 0x0f) != 8 || (uint8_t(stream[0]) * 256 + uint8_t(stream[1])) % 31)
+        return false;
+
+#ifdef RT_HAVE_ZLIB
+    // zlib checks the Adler-32 itself. The output is at most a few times larger than the rows of the test images
+    uLongf size = static_cast<uLongf>(stream.size() * 1100 + 1024);
+    out.assign(size, '\0');
+    if (uncompress(reinterpret_cast<Bytef*>(&out[0]), &size, reinterpret_cast<const Bytef*>(stream.data()),
+                   stream.size()) != Z_OK)
+        return false;
+    out.resize(size);
+#else
+    // Stored blocks only, the encoder writes nothing else without zlib
+    out.clear();
+    size_t at = 2;
+    bool last = false;
+    while (!last) {
+        if (at + 5 > stream.size() || (uint8_t(stream[at]) & 0x06) != 0)
+            return false;
+        last = uint8_t(stream[at]) & 1;
+        uint16_t len = uint8_t(stream[at+1]) | uint8_t(stream[at+2]) << 8;
+        uint16_t nlen = uint8_t(stream[at+3]) | uint8_t(stream[at+4]) << 8;
+        at += 5;
+        if (uint16_t(~nlen) != len || at + len > stream.size())
+            return false;
+        out.append(stream, at, len);
+        at += len;
+    }
+    if (at + 4 != stream.size())
+        return false;
+#endif
+
+    return be32(stream, stream.size() - 4) == adler32(out);
+}
+
+struct png_image {
+    uint32_t width = 0, height = 0;
+    std::vector<uint8_t> rgb;       // Rows from the top
+};
+
+// Reads a PNG as encode_png writes it. False if a chunk is cut or fails its CRC, or the data doesn't add up
+bool read_png(const std::string& file, png_image& out) {
+    if (file.compare(0, 8, "\x89PNG\r\n\x1a\n") != 0)
+        return false;
+
+    std::string idat;
+    bool header = false, end = false;
+    size_t at = 8;
+    while (!end) {
+        if (at + 12 > file.size())
+            return false;
+        uint32_t length = be32(file, at);
+        if (length > file.size() - at - 12)
+            return false;
+        std::string type = file.substr(at + 4, 4);
+        std::string data = file.substr(at + 8, length);
+        if (be32(file, at + 8 + length) != crc32_bitwise(type + data))
+            return false;
+        at += 12 + length;
+
+        if (type == "IHDR") {
+            if (length != 13 || data.compare(8, 5, std::string("\x08\x02\x00\x00\x00", 5)) != 0)
+                return false;
+            out.width = be32(data, 0);
+            out.height = be32(data, 4);
+            header = true;
+        } else if (type == "IDAT") {
+            idat += data;
+        } else if (type == "IEND") {
+            end = true;
+        }
+    }
+    if (!header || at != file.size())
+        return false;
+
+    std::string raw;
+    size_t stride = size_t(out.width) * 3;
+    if (!inflate_zlib(idat, raw) || raw.size() != (stride + 1) * out.height)
+        return false;
+
+    // Filters None and Up only
+    out.rgb.assign(stride * out.height, 0);
+    for (size_t row = 0; row < out.height; ++row) {
+        uint8_t filter = uint8_t(raw[row * (stride + 1)]);
+        const auto* line = reinterpret_cast<const uint8_t*>(raw.data() + row * (stride + 1) + 1);
+        for (size_t k = 0; k < stride; ++k) {
+            uint8_t up = row > 0 ? out.rgb[(row - 1) * stride + k] : 0;
+            if (filter == 0)
+                out.rgb[row * stride + k] = line[k];
+            else if (filter == 2)
+                out.rgb[row * stride + k] = uint8_t(line[k] + up);
+            else
+                return false;
+        }
+    }
+    return true;
+}
+
+void check_png() {
+    for (auto size : {std::make_pair(1, 1), std::make_pair(17, 9), std::make_pair(300, 250)}) {
+        auto image = test_image(size.first, size.second);
+        auto file = encode_png(image);
+
+        png_image decoded;
+        CHECK(read_png(file, decoded));
+        CHECK(decoded.width == uint32_t(image.width) && decoded.height == uint32_t(image.height));
+        CHECK(decoded.rgb == rgb_bytes(image));
+
+        // The reader above does catch a cut file or a flipped bit, in the chunks or in the compressed rows
+        CHECK(!read_png(file.substr(0, file.size() - 1), decoded));
+        for (size_t at : {size_t(20), file.size() / 2, file.size() - 15}) {
+            auto corrupted = file;
+            corrupted[at] ^= 0x10;
+            CHECK(!read_png(corrupted, decoded));
+        }
+    }
+
+    // The table CRC of the encoder against the bitwise one
+    std::string text = "IEND";
+    CHECK(crc32_update(0, reinterpret_cast<const uint8_t*>(text.data()), text.size()) == 0xae426082u);
+}
+
+void check_zlib() {
+    // Across the 65535 bytes of a stored block
+    for (size_t size : {size_t(0), size_t(1), size_t(65535), size_t(65536), size_t(200000)}) {
+        std::string data(size, '\0');
+        for (size_t k = 0; k < size; ++k)
+            data[k] = char((k * 7919) >> 3);
+
+        std::string inflated;
+        CHECK(inflate_zlib(zlib_compress(data), inflated));
+        CHECK(inflated == data);
+    }
+}
+
+void check_pfm() {
+    auto image = test_image(19, 11);
+    auto file = encode_pfm(image);
+
+    std::istringstream in(file);
+    std::string magic;
+    int width = 0, height = 0;
+    double scale = 0;
+    in >> magic >> width >> height >> scale;
+    in.get();
+    CHECK(magic == "PF" && width == image.width && height == image.height && scale < 0);
+
+    // Bottom row first, little-endian floats, the average of the samples without gamma
+    std::vector<float> values(size_t(width) * height * 3);
+    in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)));
+    CHECK(in.gcount() == static_cast<std::streamsize>(values.size() * sizeof(float)));
+    CHECK(in.peek() == std::char_traits<char>::eof());
+
+    bool same = true;
+    for (int j = 0; j < height; ++j)
+        for (int i = 0; i < width; ++i)
+            for (int k = 0; k < 3; ++k)
+                same = same && values[(size_t(j) * width + i) * 3 + k] == float(pixel_average(image, i, j)[k]);
+    CHECK(same);
+}
+
+void check_ppm() {
+    auto image = test_image(23, 5);
+    auto rgb = rgb_bytes(image);
+
+    auto binary = encode_ppm(image);
+    std::string header = "P6\n23 5\n255\n";
+    CHECK(binary.compare(0, header.size(), header) == 0);
+    CHECK(binary.substr(header.size()) == std::string(rgb.begin(), rgb.end()));
+
+    // The ASCII form has the same bytes, and the same as write_color
+    std::istringstream in(encode_p3(image));
+    std::string magic;
+    int width = 0, height = 0, max = 0;
+    in >> magic >> width >> height >> max;
+    CHECK(magic == "P3" && width == 23 && height == 5 && max == 255);
+
+    std::vector<uint8_t> ascii;
+    int v;
+    while (in >> v)
+        ascii.push_back(uint8_t(v));
+    CHECK(ascii == rgb);
+
+    // write_color needs samples in every pixel
+    auto sampled = test_image(23, 5, true);
+    std::ostringstream colors;
+    for (int j = sampled.height - 1; j >= 0; --j)
+        for (int i = 0; i < sampled.width; ++i)
+            write_color(colors, sampled.at(i, j), sampled.sample_count(i, j));
+    CHECK(colors.str() == encode_p3(sampled).substr(header.size()));
+}
+
+}
+
+int main() {
+    check_png();
+    check_zlib();
+    check_pfm();
+    check_ppm();
+
+    return check_result();
+}
\ No newline at end of file
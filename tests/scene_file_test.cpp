@@ -0,0 +1,213 @@
+#include "rtweekend.h"
+
+#include "check.h"
+#include "material.h"
+#include "scene_file.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Round trips of the text and binary forms of scene_file.h, and binary files that are truncated or corrupted
+
+namespace {
+
+const char* scene_text =
+    "camera  3 3 2  0 0 -1  0 1 0  20 1.5 0.1 3.4\n"
+    "lambertian  ground  0.8 0.8 0.0\n"
+    "metal       gold    0.8 0.6 0.2  0.5\n"
+    "dielectric  glass   1.5\n"
+    "sphere  0 -100.5 -1  100   ground\n"
+    "sphere  0 0 -1       0.5   gold\n"
+    "sphere  -1 0 -1      0.5   glass\n"
+    "sphere  1 0 -1       0.5   gold     # comment\n"
+    "sphere  -1 0 -1      -0.4  glass\n";
+
+const std::string binary_path = "scene_file_test.rtscene";
+const std::string corrupt_path = "scene_file_test_corrupt.rtscene";
+
+loaded_scene text_scene(const std::string& text) {
+    std::istringstream in(text);
+    return read_scene_text(in);
+}
+
+bool same_camera(const camera_settings& a, const camera_settings& b) {
+    for (int k = 0; k < 3; ++k)
+        if (a.lookfrom[k] != b.lookfrom[k] || a.lookat[k] != b.lookat[k] || a.vup[k] != b.vup[k])
+            return false;
+    return a.vfov == b.vfov && a.aspect_ratio == b.aspect_ratio && a.aperture == b.aperture
+        && a.focus_dist == b.focus_dist;
+}
+
+bool same_material(const material& a, const material& b) {
+    if (a.kind != b.kind)
+        return false;
+
+    switch (a.kind) {
+        case material_kind::lambertian: {
+            auto& x = static_cast<const lambertian&>(a);
+            auto& y = static_cast<const lambertian&>(b);
+            return x.albedo[0] == y.albedo[0] && x.albedo[1] == y.albedo[1] && x.albedo[2] == y.albedo[2];
+        }
+        case material_kind::metal: {
+            auto& x = static_cast<const metal&>(a);
+            auto& y = static_cast<const metal&>(b);
+            return x.albedo[0] == y.albedo[0] && x.albedo[1] == y.albedo[1] && x.albedo[2] == y.albedo[2]
+                && x.fuzz == y.fuzz;
+        }
+        case material_kind::dielectric:
+            return static_cast<const dielectric&>(a).ir == static_cast<const dielectric&>(b).ir;
+        default:
+            return false;
+    }
+}
+
+bool same_scene(const loaded_scene& a, const loaded_scene& b) {
+    const auto& x = a.world;
+    const auto& y = b.world;
+    if (x.node_count != y.node_count || x.sphere_count != y.sphere_count || x.material_count != y.material_count)
+        return false;
+    if (std::memcmp(x.nodes, y.nodes, x.node_count * sizeof(linear_bvh_node)) != 0
+        || std::memcmp(x.spheres, y.spheres, x.sphere_count * sizeof(packed_sphere)) != 0)
+        return false;
+    for (size_t k = 0; k < x.material_count; ++k)
+        if (!same_material(*x.materials[k], *y.materials[k]))
+            return false;
+    return same_camera(a.view, b.view);
+}
+
+void check_round_trips() {
+    auto original = text_scene(scene_text);
+    CHECK(original.world.sphere_count == 5);
+    CHECK(original.world.material_count == 3);
+
+    // Binary
+    save_scene_binary(binary_path, original.world, original.view);
+    auto mapped = load_scene_binary(binary_path);
+    CHECK(same_scene(original, mapped));
+
+    hit_record rec_original, rec_mapped;
+    ray r(point3(0, 0, 1), vec3(0, 0, -1));
+    CHECK(original.world.hit(r, 0.001, infinity, rec_original));
+    CHECK(mapped.world.hit(r, 0.001, infinity, rec_mapped));
+    CHECK(rec_original.t == rec_mapped.t);
+
+    // Text, written at full precision, then binary again: the same bytes
+    std::ostringstream text;
+    write_scene_text(text, mapped.world, mapped.view);
+    auto reread = text_scene(text.str());
+    CHECK(same_scene(original, reread));
+
+    auto first = read_file(binary_path);
+    save_scene_binary(binary_path, reread.world, reread.view);
+    CHECK(read_file(binary_path) == first);
+
+    // load_scene tells the forms apart
+    CHECK(same_scene(original, load_scene(binary_path)));
+    write_file(corrupt_path, scene_text);
+    CHECK(same_scene(original, load_scene(corrupt_path)));
+}
+
+void check_text_errors() {
+    CHECK_THROWS(std::runtime_error, text_scene("sphere 0 0 0 1 nowhere\n"));
+    CHECK_THROWS(std::runtime_error, text_scene("lambertian m 1 1\n"));
+    CHECK_THROWS(std::runtime_error, text_scene("lambertian m 1 1 1 1\n"));
+    CHECK_THROWS(std::runtime_error, text_scene("cube 0 0 0 1\n"));
+    CHECK_THROWS(std::runtime_error, text_scene("lambertian m 1 1 1\n"));
+}
+
+// Copy of the file with the bytes at offset replaced by value
+template <typename T>
+std::string patched(const std::string& file, size_t offset, T value) {
+    auto data = file;
+    std::memcpy(&data[offset], &value, sizeof(value));
+    return data;
+}
+
+// Whether load_scene_binary refuses a file of this content
+bool rejected(const std::string& data) {
+    write_file(corrupt_path, data);
+    try {
+        load_scene_binary(corrupt_path);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void check_truncated_and_corrupted() {
+    auto original = text_scene(scene_text);
+    save_scene_binary(binary_path, original.world, original.view);
+    auto file = read_file(binary_path);
+
+    scene_file_header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    // Every length short of the whole file
+    for (size_t size = 0; size < file.size(); ++size)
+        CHECK(rejected(file.substr(0, size)));
+
+    // A longer file than the header says
+    CHECK(rejected(file + std::string(scene_file_alignment, '\0')));
+
+    // Header
+    CHECK(rejected(patched(file, offsetof(scene_file_header, magic), 'X')));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, version), scene_file_version + 1)));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, real_size), uint32_t(3))));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, node_count), uint64_t(0))));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, node_count), uint64_t(1) << 60)));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, sphere_count), header.sphere_count + 1000)));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, material_count), header.material_count + 1000)));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, node_offset), ~uint64_t(0) - 63)));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, sphere_offset), header.file_size + scene_file_alignment)));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, material_offset), header.material_offset + 8)));
+    CHECK(rejected(patched(file, offsetof(scene_file_header, file_size), header.file_size - 1)));
+
+    // A sphere with a material past the table
+    CHECK(rejected(patched(file, header.sphere_offset + offsetof(packed_sphere, material),
+                           static_cast<uint32_t>(header.material_count))));
+
+    // BVH: the second child of the root out of the array or in place of the first, a bad axis, then a leaf past the
+    // spheres
+    size_t root = header.node_offset;
+    CHECK(original.world.nodes[0].count == 0);
+    CHECK(rejected(patched(file, root + offsetof(linear_bvh_node, offset), static_cast<uint32_t>(header.node_count))));
+    CHECK(rejected(patched(file, root + offsetof(linear_bvh_node, offset), uint32_t(1))));
+    CHECK(rejected(patched(file, root + offsetof(linear_bvh_node, axis), uint8_t(3))));
+
+    for (size_t k = 0; k < header.node_count; ++k) {
+        const auto& node = original.world.nodes[k];
+        size_t at = header.node_offset + k * sizeof(linear_bvh_node);
+        if (node.count > 0) {
+            CHECK(rejected(patched(file, at + offsetof(linear_bvh_node, offset),
+                                   static_cast<uint32_t>(header.sphere_count - node.count + 1))));
+            CHECK(rejected(patched(file, at + offsetof(linear_bvh_node, count),
+                                   static_cast<uint16_t>(header.sphere_count + 1))));
+            break;
+        }
+    }
+
+    // Unknown material kind
+    CHECK(rejected(patched(file, header.material_offset + offsetof(scene_file_material, kind),
+                           static_cast<uint32_t>(material_kind::custom))));
+    CHECK(rejected(patched(file, header.material_offset + offsetof(scene_file_material, kind), uint32_t(256))));
+
+    // The file itself still loads
+    write_file(corrupt_path, file);
+    CHECK(same_scene(original, load_scene_binary(corrupt_path)));
+}
+
+}
+
+int main() {
+    check_round_trips();
+    check_text_errors();
+    check_truncated_and_corrupted();
+
+    std::remove(binary_path.c_str());
+    std::remove(corrupt_path.c_str());
+    return check_result();
+}
\ No newline at end of file
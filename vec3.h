@@ -6,13 +6,32 @@
 
 using std::sqrt;
 
-class vec3 {
+/*3D vector with coordinates of type T, float or double. The renderer uses vec3 = vec3_t<real>, see rtweekend.h.
+
+In the free functions below the scalar arguments are of type vec3_t<T>::scalar rather than T, so T is only deduced
+from the vectors: 2*v or (1.0-t)*v still work when v holds floats.
+
+Built with -DRT_SIMD_VEC3, the coordinates are padded to 4 lanes (the last one always 0) and aligned to 16 or 32 bytes,
+and the arithmetic runs on whole SIMD registers through GCC's vector extensions, which map to SSE, AVX or NEON
+depending on the target (see https://gcc.gnu.org/onlinedocs/gcc/Vector-Extensions.html). The public interface is the
+same, and each result is computed with the same operations in the same order, so both backends give the same image.
+vec3_bench.cpp compares them.*/
+
+template <typename T>
+class vec3_t {
     public:
+        using scalar = T;
 
         // Member Initializer List for the variable "e". See https://stackoverflow.com/questions/1711990/what-is-this-weird-colon-member-syntax-in-the-constructor 
         // and https://www.learncpp.com/cpp-tutorial/constructor-member-initializer-lists/
-        vec3() : e{0,0,0} {}                                        // Defines the "0" vector. Just call with no arguments
-        vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}    // Defines a 3D vector. Here "e" is the variable name
+#ifdef RT_SIMD_VEC3
+        // Written as one vector store: a vector load right after three scalar stores would stall the CPU
+        vec3_t() { store(simd{0, 0, 0, 0}); }
+        vec3_t(T e0, T e1, T e2) { store(simd{e0, e1, e2, 0}); }
+#else
+        vec3_t() : e{0,0,0} {}                                      // Defines the "0" vector. Just call with no arguments
+        vec3_t(T e0, T e1, T e2) : e{e0, e1, e2} {}                 // Defines a 3D vector. Here "e" is the variable name
+#endif
 
         // We define a print function to show the whole vector
         void print() {std :: cout << e[0] << " " << e[1] << " " << e[2] <<"\n";}
@@ -20,9 +39,9 @@ class vec3 {
         // Here we define member functions/class methods which output the coordinates. E.g, for
         // vec3 foo = {5,0,0};  
         // foo.e[0] outputs 5
-        double x() const { return e[0]; }
-        double y() const { return e[1]; }
-        double z() const { return e[2]; }
+        T x() const { return e[0]; }
+        T y() const { return e[1]; }
+        T z() const { return e[2]; }
 
         /*Below we have a series of operator overloadings.
         
@@ -34,150 +53,229 @@ class vec3 {
         Moreover, const is somewhat used for safety and documentation purposes, 
         when we don't want the object to change: https://stackoverflow.com/questions/4486326/does-const-just-mean-read-only-or-something-more*/
         
-        vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); } // Allows us to write -v
-        double operator[](int i) const { return e[i]; }              // v[i] returns the i-th coordinate
-        double& operator[](int i) { return e[i]; }                   // The & is used for reference. See e.g. https://stackoverflow.com/questions/4629317/what-does-int-mean
+#ifdef RT_SIMD_VEC3
+        vec3_t operator-() const { return from_lanes(-lanes()); }
+#else
+        vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); } // Allows us to write -v
+#endif
+        T operator[](int i) const { return e[i]; }                   // v[i] returns the i-th coordinate
+        T& operator[](int i) { return e[i]; }                        // The & is used for reference. See e.g. https://stackoverflow.com/questions/4629317/what-does-int-mean
 
         // Vector addition. E.g. vectorA+=vec3(1, 5, 0) add (1, 5, 0) to vectorA;
-        vec3& operator+=(const vec3 &v) {
+        vec3_t& operator+=(const vec3_t &v) {
+#ifdef RT_SIMD_VEC3
+            return *this = from_lanes(lanes() + v.lanes());
+#else
             e[0] += v.e[0];
             e[1] += v.e[1];
             e[2] += v.e[2];
             return *this;   // *this points to the vector (e0, e1, e2). See: https://www.tutorialspoint.com/cplusplus/cpp_this_pointer.htm
+#endif
         }
 
         // Scalar multiplication and division
-        vec3& operator*=(const double t) {
+        vec3_t& operator*=(const T t) {
+#ifdef RT_SIMD_VEC3
+            return *this = from_lanes(t * lanes());
+#else
             e[0] *= t;
             e[1] *= t;
             e[2] *= t;
             return *this;
+#endif
         }
 
-        vec3& operator/=(const double t) {
+        vec3_t& operator/=(const T t) {
             return *this *= 1/t;
         }
 
         // Vector modulus
-        double length() const {
+        T length() const {
             return sqrt(length_squared());
         }
 
-        double length_squared() const {
+        T length_squared() const {
             return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
         }
 
+#ifdef RT_SIMD_VEC3
+        // The 4 lanes as one SIMD value
+        typedef T simd __attribute__((vector_size(4 * sizeof(T))));
+
+        simd lanes() const { simd v; __builtin_memcpy(&v, e, sizeof(v)); return v; }
+        void store(const simd& v) { __builtin_memcpy(e, &v, sizeof(v)); }
+
+        static vec3_t from_lanes(const simd& v) {
+            vec3_t r(no_init{});
+            r.store(v);
+            return r;
+        }
+
+    private:
+        struct no_init {};
+        explicit vec3_t(no_init) {}
+
+    public:
+#endif
+
     // Coordinates of the vector
     public:
-        double e[3];
+#ifdef RT_SIMD_VEC3
+        alignas(4 * sizeof(T)) T e[4];  // e[3] is padding
+#else
+        T e[3];
+#endif
 
         /*Random vectors for diffusive materials*/
-        inline static vec3 random() {
-            return vec3(random_double(), random_double(), random_double());
+        inline static vec3_t random() {
+            return vec3_t(random_double(), random_double(), random_double());
         }
 
-        inline static vec3 random(double min, double max) {
-            return vec3(random_double(min,max), random_double(min,max), random_double(min,max));
+        inline static vec3_t random(double min, double max) {
+            return vec3_t(random_double(min,max), random_double(min,max), random_double(min,max));
         }
 
         // Deals with zeroes in the Lambert reflecion
         bool near_zero() const {
             // Return true if the vector is close to zero in all dimensions.
             const auto s = 1e-8;
-            return (fabs(e[0]) < s) && (fabs(e[1]) < s) && (fabs(e[2]) < s);
+            return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
         }
 };
 
 // vec3 Utility Functions
 
 // Overloads the cout function. This way we can print the vectors using cout. E.g., cout << vectorA;
-inline std::ostream& operator<<(std::ostream &out, const vec3 &v) {
+template <typename T>
+inline std::ostream& operator<<(std::ostream &out, const vec3_t<T> &v) {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
+#ifndef RT_SIMD_VEC3
+
 // Performs binary operations on vectors such as u + v, and so on.
-inline vec3 operator+(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline vec3 operator-(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
 // Here we define a direct product between then, i.e. u*v = (u1*v1, u2*v2, u3*v3)
-inline vec3 operator*(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
 // Scalar multiplication
-inline vec3 operator*(double t, const vec3 &v) {
-    return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(typename vec3_t<T>::scalar t, const vec3_t<T> &v) {
+    return vec3_t<T>(t*v.e[0], t*v.e[1], t*v.e[2]);
 }
 
 // The operation above defines "t*v". Here we define the operation v*t (which should be the same)
-inline vec3 operator*(const vec3 &v, double t) {
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &v, typename vec3_t<T>::scalar t) {
     return t * v;
 }
 
-inline vec3 operator/(vec3 v, double t) {
+template <typename T>
+inline vec3_t<T> operator/(vec3_t<T> v, typename vec3_t<T>::scalar t) {
     return (1/t) * v;
 }
 
 // Defines the dot product between two vecctors
-inline double dot(const vec3 &u, const vec3 &v) {
+template <typename T>
+inline T dot(const vec3_t<T> &u, const vec3_t<T> &v) {
     return u.e[0] * v.e[0]
          + u.e[1] * v.e[1]
          + u.e[2] * v.e[2];
 }
 
 // Defines the cross product between two vectors
-inline vec3 cross(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
                 u.e[2] * v.e[0] - u.e[0] * v.e[2],
                 u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline vec3 unit_vector(vec3 v) {
-    return v / v.length();
+#else
+
+// The same operations on the 4 lanes. Lane 3 stays 0 through all of them
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>::from_lanes(u.lanes() + v.lanes());
+}
+
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>::from_lanes(u.lanes() - v.lanes());
 }
 
-// Random point inside a unit sphere by rejection
-vec3 random_in_unit_sphere() {
-    while (true) {
-        auto p = vec3::random(-1,1);
-        if (p.length_squared() >= 1) continue;
-        return p;
-    }
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &u, const vec3_t<T> &v) {
+    return vec3_t<T>::from_lanes(u.lanes() * v.lanes());
 }
 
-// Random unit vector used in the Lambertian reflection
-vec3 random_unit_vector() {
-    return unit_vector(random_in_unit_sphere());
+template <typename T>
+inline vec3_t<T> operator*(typename vec3_t<T>::scalar t, const vec3_t<T> &v) {
+    return vec3_t<T>::from_lanes(t * v.lanes());
+}
+
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &v, typename vec3_t<T>::scalar t) {
+    return t * v;
+}
+
+template <typename T>
+inline vec3_t<T> operator/(vec3_t<T> v, typename vec3_t<T>::scalar t) {
+    return (1/t) * v;
+}
+
+// The products in parallel, then the sum in the same order as the scalar version
+template <typename T>
+inline T dot(const vec3_t<T> &u, const vec3_t<T> &v) {
+    auto p = u.lanes() * v.lanes();
+    return p[0] + p[1] + p[2];
+}
+
+// u.yzx * v.zxy - u.zxy * v.yzx
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T> &u, const vec3_t<T> &v) {
+    auto a = u.lanes();
+    auto b = v.lanes();
+    return vec3_t<T>::from_lanes(__builtin_shufflevector(a, a, 1, 2, 0, 3) * __builtin_shufflevector(b, b, 2, 0, 1, 3)
+                               - __builtin_shufflevector(a, a, 2, 0, 1, 3) * __builtin_shufflevector(b, b, 1, 2, 0, 3));
+}
+
+#endif
+
+template <typename T>
+inline vec3_t<T> unit_vector(vec3_t<T> v) {
+    return v / v.length();
 }
 
 // Equal-angle reflection for metals
-vec3 reflect(const vec3& v, const vec3& n) {
+template <typename T>
+vec3_t<T> reflect(const vec3_t<T>& v, const vec3_t<T>& n) {
     return v - 2*dot(v,n)*n;
 }
 
 // Refraction for u given n
-vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
-    auto cos_theta = fmin(dot(-uv, n), 1.0);                                    // First quadrant for R.n = cos(theta)
-    vec3 r_out_perp =  etai_over_etat * (uv + cos_theta*n);                     // R_\{perp}' = eta/eta' (R + cos(theta)n)
-    vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;   // R_{||} = - sqrt(1-|R_{\perp}'|^2)n
+template <typename T>
+vec3_t<T> refract(const vec3_t<T>& uv, const vec3_t<T>& n, typename vec3_t<T>::scalar etai_over_etat) {
+    T cos_theta = fmin(dot(-uv, n), T(1));                                      // First quadrant for R.n = cos(theta)
+    vec3_t<T> r_out_perp =  etai_over_etat * (uv + cos_theta*n);                // R_\{perp}' = eta/eta' (R + cos(theta)n)
+    vec3_t<T> r_out_parallel = -sqrt(std::fabs(1 - r_out_perp.length_squared())) * n;  // R_{||} = - sqrt(1-|R_{\perp}'|^2)n
     return r_out_perp + r_out_parallel;                                         // R = R_{\perp} + R_{||}
 }
 
-// Random point inside unit disk (by rejection)
-vec3 random_in_unit_disk() {
-    while (true) {
-        auto p = vec3(random_double(-1,1), random_double(-1,1), 0);
-        if (p.length_squared() >= 1) continue;
-        return p;
-    }
-}
-
 // Type aliases for vec3
+using vec3 = vec3_t<real>;
 using point3 = vec3;   // 3D point
 using color = vec3;    // RGB color
 
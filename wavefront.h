@@ -0,0 +1,150 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "rtweekend.h"
+
+#include "framebuffer.h"
+#include "hittable.h"
+#include "material.h"
+#include "material_batch.h"
+#include "render.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/*Wavefront (breadth-first) path tracing.
+
+ray_color follows one path at a time, recursively, and does everything for one bounce before moving to the next:
+intersection, material, sky. Here all the paths of a tile advance together, one bounce at a time, and each step is a
+separate loop over all of them:
+
+    1. intersect: closest hit of every live path
+    2. miss:      paths that left the scene pick up the sky color and end
+    3. scatter:   the other paths are grouped by material kind and scattered, each kind in one tight loop
+                  (see material_batch.h)
+    4. compact:   dead paths are dropped from the queue before the next bounce
+
+Each loop does a single kind of work over arrays, which is what the compiler (and a future SIMD or GPU version) needs.
+
+Every path carries its own random stream, derived from its pixel and sample number, since the paths of a pixel no longer
+run one after the other. The image is therefore statistically the same as with ray_color, not identical.*/
+
+const int wavefront_samples_per_wave = 16;      // Samples per pixel launched together, bounds the memory per tile
+
+// State of the paths in flight, as a structure of arrays
+struct path_queue {
+    std::vector<ray> rays;
+    std::vector<color> throughput;      // Product of the attenuations so far
+    std::vector<rng> streams;
+    std::vector<int> pixel;             // Index of the pixel in the tile
+    std::vector<int> bounces;
+    std::vector<hit_record> rec;
+    std::vector<uint8_t> hit;
+    std::vector<color> attenuation;     // Results of the scatter
+    std::vector<ray> scattered;
+    std::vector<uint8_t> alive;
+
+    scatter_batch batch() {
+        return {rays.data(), rec.data(), streams.data(), attenuation.data(), scattered.data(), alive.data()};
+    }
+
+    void resize(size_t n) {
+        rays.resize(n);
+        throughput.resize(n);
+        streams.resize(n);
+        pixel.resize(n);
+        bounces.resize(n);
+        rec.resize(n);
+        hit.resize(n);
+        attenuation.resize(n);
+        scattered.resize(n);
+        alive.resize(n);
+    }
+};
+
+// Renders with make_ray(i, j) as the camera and background(r) as the color of the rays that miss everything
+template <typename MakeRay, typename Background>
+bool render_wavefront(const render_settings& settings, framebuffer& image, const hittable& world, real t_min,
+                      MakeRay make_ray, Background background) {
+
+    return render_tiles(settings, [&](const tile& t) {
+
+        int tile_width = t.x1 - t.x0;
+        int pixels = tile_width * (t.y1 - t.y0);
+        std::vector<color> sums(pixels);
+
+        path_queue paths;
+        paths.resize(static_cast<size_t>(pixels) * wavefront_samples_per_wave);
+        std::vector<uint32_t> active, scattering;
+        material_groups groups;
+
+        for (int s0 = 0; s0 < settings.samples_per_pixel; s0 += wavefront_samples_per_wave) {
+            int wave = std::min(wavefront_samples_per_wave, settings.samples_per_pixel - s0);
+
+            // Camera rays
+            active.clear();
+            for (int p = 0; p < pixels; ++p) {
+                int i = t.x0 + p % tile_width;
+                int j = t.y0 + p / tile_width;
+                auto stream = pixel_stream(settings, i, j) * settings.samples_per_pixel;
+
+                for (int s = 0; s < wave; ++s) {
+                    auto k = static_cast<uint32_t>(active.size());
+                    thread_rng() = rng(settings.seed, stream + s0 + s);
+                    paths.rays[k] = make_ray(i, j);
+                    paths.streams[k] = thread_rng();
+                    paths.throughput[k] = color(1, 1, 1);
+                    paths.pixel[k] = p;
+                    paths.bounces[k] = 0;
+                    active.push_back(k);
+                }
+            }
+
+            while (!active.empty()) {
+
+                // 1. Intersect
+                for (auto k : active) {
+                    paths.hit[k] = world.hit(paths.rays[k], t_min, infinity, paths.rec[k]);
+                    RT_STAT(paths.bounces[k] > 0 ? local_stats().secondary_rays++ : local_stats().camera_rays++);
+                }
+
+                // 2. Miss: the sky ends the path
+                scattering.clear();
+                for (auto k : active) {
+                    if (paths.hit[k]) {
+                        scattering.push_back(k);
+                    } else {
+                        sums[paths.pixel[k]] += paths.throughput[k] * background(paths.rays[k]);
+                        RT_STAT(count_path(paths.bounces[k] + 1));
+                    }
+                }
+
+                // 3. Scatter, grouped by material kind
+                groups.clear();
+                groups.add(paths.rec.data(), scattering);
+                scatter_all(paths.batch(), groups);
+
+                // 4. Compact: absorbed paths and paths out of bounces add nothing, they just leave the queue
+                active.clear();
+                for (auto k : scattering) {
+                    if (!paths.alive[k] || ++paths.bounces[k] >= settings.max_depth) {
+                        // An absorbed path ends without the increment
+                        RT_STAT(count_path(paths.bounces[k] + !paths.alive[k], paths.alive[k]));
+                        continue;
+                    }
+
+                    paths.rays[k] = paths.scattered[k];
+                    paths.throughput[k] = paths.throughput[k] * paths.attenuation[k];
+                    active.push_back(k);
+                }
+            }
+        }
+
+        for (int p = 0; p < pixels; ++p)
+            image.store(t.x0 + p % tile_width, t.y0 + p / tile_width, sums[p], settings.samples_per_pixel);
+    });
+}
+
+#endif
\ No newline at end of file